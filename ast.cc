@@ -3,6 +3,9 @@
 #include "ast.h"
 #include "ast_type.h"
 #include "ast_decl.h"
+#include "list.h"
+#include "astcache.h"
+#include "stats.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -11,6 +14,7 @@
 Node::Node(yyltype loc)
 {
     location_ = new yyltype(loc);
+    CountAlloc(LocationMem, sizeof(yyltype));
     parent_ = NULL;
     checked_ = false;
 
@@ -50,7 +54,9 @@ void Node::DoCheck(void)
 
 void Node::Check(void)
 {
+    Count(CheckCalls);
     if (!checked_) {
+        Count(DoCheckRuns);
         checked_ = true;
         DoCheck();
     }
@@ -58,17 +64,35 @@ void Node::Check(void)
     return;
 }
 
-ClassDecl *Node::GetClass(NamedType *t)
+int Node::Save(AstWriter *w)
 {
-    ClassDecl *c;
+    w->Unsupported();
+
+    return 0;
+}
+
+void Node::GetChildren(List<Node*> *children)
+{
+    return;
+}
+
+Decl *Node::GetTypeDecl(NamedType *t)
+{
+    Decl *d;
 
     if (parent() != NULL) {
-        c = parent()->GetClass(t);
+        d = parent()->GetTypeDecl(t);
     } else {
-        c = NULL;
+        d = NULL;
     }
 
-    return c;
+    return d;
+}
+
+ClassDecl *Node::GetClass(NamedType *t)
+{
+    Count(LookupCasts);
+    return dynamic_cast<ClassDecl*>(GetTypeDecl(t));
 }
 
 ClassDecl *Node::GetCurrentClass(void)
@@ -97,21 +121,15 @@ FnDecl *Node::GetCurrentFn(void)
 
 InterfaceDecl *Node::GetInterface(NamedType *t)
 {
-    InterfaceDecl *i;
-
-    if (parent() != NULL) {
-        i = parent()->GetInterface(t);
-    } else {
-        i = NULL;
-    }
-
-    return i;
+    Count(LookupCasts);
+    return dynamic_cast<InterfaceDecl*>(GetTypeDecl(t));
 }
 
 FnDecl *Node::GetFn(Identifier *id)
 {
     FnDecl *f;
 
+    Count(FnHops);
     if (parent() != NULL) {
         f = parent()->GetFn(id);
     } else {
@@ -125,6 +143,7 @@ VarDecl *Node::GetVar(Identifier *id)
 {
     VarDecl *v;
 
+    Count(VarHops);
     if (parent() != NULL) {
         v = parent()->GetVar(id);
     } else {
@@ -134,15 +153,36 @@ VarDecl *Node::GetVar(Identifier *id)
     return v;
 }
 
+Program *Node::GetProgram(void)
+{
+    Program *p;
+
+    if (parent() != NULL) {
+        p = parent()->GetProgram();
+    } else {
+        p = NULL;
+    }
+
+    return p;
+}
+
 /*** class Identifier *************************************************/
 
 Identifier::Identifier(yyltype loc, const char *n) : Node(loc)
 {
-    name_ = strdup(n);
+    name_ = CountedStrdup(NameMem, n);
 
     return;
 }
 
+int Identifier::Save(AstWriter *w)
+{
+    int r = w->Begin(AstIdentifier, location_);
+    w->PutString(name_);
+
+    return r;
+}
+
 char *Identifier::name(void)
 {
     return name_;
@@ -7,14 +7,20 @@
 #include <iostream>
 
 #include "location.h"
+#include "memstats.h"
 
+class Decl;
 class FnDecl;
 class VarDecl;
 class ClassDecl;
 class InterfaceDecl;
 class NamedType;
+class Program;
 
 class Identifier;
+class AstWriter;
+
+template<class Element> class List;
 
 class Node
 {
@@ -29,6 +35,10 @@ class Node
         Node(yyltype loc);
         Node(void);
 
+        // Counted by class under --mem-report (see memstats.h)
+        static void *operator new(size_t size) { return NodeAlloc(size); }
+        static void operator delete(void *p) { NodeFree(p); }
+
         yyltype *location(void);
 
         void set_parent(Node *p);
@@ -36,12 +46,26 @@ class Node
 
         void Check(void);
 
-        virtual ClassDecl *GetClass(NamedType *t);
+        // Write this node and everything below it as records of an
+        // AST cache file (see astcache.h), returning its record.
+        virtual int Save(AstWriter *w);
+
+        // Append the declarations, statements and expressions directly
+        // below this node, in source order. Used by the analyses that
+        // run over the checked tree; types and identifiers are omitted.
+        virtual void GetChildren(List<Node*> *children);
+
+        // Class and interface names share one namespace, so a single
+        // walk up the scopes finds whichever declares the name; GetClass
+        // and GetInterface just narrow the result of that walk.
+        virtual Decl *GetTypeDecl(NamedType *t);
+        ClassDecl *GetClass(NamedType *t);
         virtual ClassDecl *GetCurrentClass(void);
-        virtual InterfaceDecl *GetInterface(NamedType *t);
+        InterfaceDecl *GetInterface(NamedType *t);
         virtual FnDecl *GetFn(Identifier *id);
         virtual FnDecl *GetCurrentFn(void);
         virtual VarDecl *GetVar(Identifier *id);
+        virtual Program *GetProgram(void);
 };
 
 class Identifier : public Node
@@ -51,6 +75,7 @@ class Identifier : public Node
 
     public:
         Identifier(yyltype loc, const char *n);
+        int Save(AstWriter *w);
         char *name(void);
         friend std::ostream& operator<<(std::ostream& out,
                                         Identifier *id);
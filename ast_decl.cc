@@ -3,9 +3,13 @@
 #include "ast_decl.h"
 #include "ast_type.h"
 #include "ast_stmt.h"
+#include "astcache.h"
+#include "xref.h"
 #include "errors.h"
 #include "hashtable.h"
 #include "list.h"
+#include "stats.h"
+#include <string>
 
 Identifier *Decl::id(void)
 {
@@ -40,15 +44,45 @@ VarDecl::VarDecl(Identifier *n, Type *t) : Decl(n)
 {
     Assert(n != NULL && t != NULL);
     (type_ = t)->set_parent(this);
+    offset_ = -1;
 
     return;
 }
 
+int VarDecl::Save(AstWriter *w)
+{
+    int id = w->Save(id_);
+    int type = w->Save(type_);
+    int r = w->Begin(AstVarDecl, NULL);
+    w->Put(id);
+    w->Put(type);
+
+    return r;
+}
+
 Type *VarDecl::type(void)
 {
     return type_;
 }
 
+int VarDecl::offset(void)
+{
+    return offset_;
+}
+
+void VarDecl::set_offset(int off)
+{
+    offset_ = off;
+
+    return;
+}
+
+bool VarDecl::IsLocal(void)
+{
+    return (dynamic_cast<ClassDecl*>(parent()) == NULL &&
+            dynamic_cast<Program*>(parent()) == NULL);
+}
+
 void ClassDecl::MergeSymbolTable(ClassDecl *base)
 {
     // (1) Conflicting declaration check
@@ -85,8 +119,7 @@ void ClassDecl::MergeSymbolTable(ClassDecl *base)
 void ClassDecl::DoCheck(void)
 {
     // (1) Conflicting declaration check
-    for (int i = 0; i < members_->NumElements(); i++) {
-        Decl *newdecl = members_->Nth(i);
+    for (Decl *newdecl : *members_) {
         char *name = newdecl->id()->name();
         Decl *olddecl = sym_table_->Lookup(name);
         if (olddecl == NULL) {
@@ -101,6 +134,7 @@ void ClassDecl::DoCheck(void)
             ReportError::IdentifierNotDeclared(extends_->id(),
                                                LookingForClass);
         } else {
+            RecordUse(XrefType, base, extends_->id());
             base->Check(); // construct sym table for base class
             MergeSymbolTable(base);
         }
@@ -108,18 +142,18 @@ void ClassDecl::DoCheck(void)
 
     // Check should always follow construction of the symbol table,
     // otherwise any forward declaration will fail.
-    for (int i = 0; i < members_->NumElements(); i++) {
-        members_->Nth(i)->Check();
+    for (Decl *member : *members_) {
+        member->Check();
     }
 
     // (3) Incomplete implementation check
-    for (int i = 0; i < implements_->NumElements(); i++) {
-        NamedType *nt = implements_->Nth(i);
+    for (NamedType *nt : *implements_) {
         InterfaceDecl *intd = parent()->GetInterface(nt);
         if (intd == NULL) {
             ReportError::IdentifierNotDeclared(nt->id(),
                                                LookingForInterface);
         } else {
+            RecordUse(XrefType, intd, nt->id());
             intd->Check(); // construct sym table for interface
             Hashtable<Decl*> *sym_impl = intd->sym_table();
             Iterator<Decl*> iter = sym_impl->GetIterator();
@@ -162,33 +196,64 @@ ClassDecl::ClassDecl(Identifier *n, NamedType *ext,
     (implements_ = impl)->set_parent_all(this);
     (members_ = memb)->set_parent_all(this);
     sym_table_ = new Hashtable<Decl*>;
+    laid_out_ = false;
+    dsize_ = size_ = align_ = 0;
+    holes_ = new List<Hole>;
+    fields_ = new List<VarDecl*>;
+    vtable_ = new List<FnDecl*>;
+    interfaces_ = new List<InterfaceDecl*>;
+    itables_ = new List<List<FnDecl*>*>;
 
     return;
 }
 
+int ClassDecl::Save(AstWriter *w)
+{
+    int id = w->Save(id_);
+    int extends = w->Save(extends_);
+    int implements = w->SaveList(implements_);
+    int members = w->SaveList(members_);
+    int r = w->Begin(AstClassDecl, NULL);
+    w->Put(id);
+    w->Put(extends);
+    w->Put(implements);
+    w->Put(members);
+
+    return r;
+}
+
 Hashtable<Decl*> *ClassDecl::sym_table(void)
 {
     return sym_table_;
 }
 
+void ClassDecl::GetChildren(List<Node*> *children)
+{
+    for (Decl *member : *members_) {
+        children->Append(member);
+    }
+
+    return;
+}
+
 ClassDecl *ClassDecl::GetCurrentClass(void)
 {
     return this;
 }
 
-ClassDecl *ClassDecl::GetClass(NamedType *t)
+Decl *ClassDecl::GetTypeDecl(NamedType *t)
 {
     Decl *d = sym_table_->Lookup(t->id()->name());
-    ClassDecl *r = dynamic_cast<ClassDecl*>(d);
     if (d == NULL) {
-        r = parent()->GetClass(t); // maybe global scope
+        d = parent()->GetTypeDecl(t); // maybe global scope
     }
 
-    return r;
+    return d;
 }
 
 VarDecl *ClassDecl::GetMemberVar(char *n)
 {
+    Count(LookupCasts);
     return dynamic_cast<VarDecl*>(sym_table_->Lookup(n));
 }
 
@@ -196,6 +261,8 @@ VarDecl *ClassDecl::GetVar(Identifier *i)
 {
     Decl *d = sym_table_->Lookup(i->name());
     VarDecl *r = dynamic_cast<VarDecl*>(d);
+    Count(VarHops);
+    Count(LookupCasts);
     if (d == NULL) {
         r = parent()->GetVar(i); // maybe global scope
     }
@@ -203,19 +270,9 @@ VarDecl *ClassDecl::GetVar(Identifier *i)
     return r;
 }
 
-InterfaceDecl *ClassDecl::GetInterface(NamedType *t)
-{
-    Decl *d = sym_table_->Lookup(t->id()->name());
-    InterfaceDecl *r = dynamic_cast<InterfaceDecl*>(d);
-    if (d == NULL) {
-        r = parent()->GetInterface(t); // maybe global scope
-    }
-
-    return r;
-}
-
 FnDecl *ClassDecl::GetMemberFn(char *n)
 {
+    Count(LookupCasts);
     return dynamic_cast<FnDecl*>(sym_table_->Lookup(n));
 }
 
@@ -223,6 +280,8 @@ FnDecl *ClassDecl::GetFn(Identifier *i)
 {
     Decl *d = sym_table_->Lookup(i->name());
     FnDecl *r = dynamic_cast<FnDecl*>(d);
+    Count(FnHops);
+    Count(LookupCasts);
     if (d == NULL) {
         r = parent()->GetFn(i); // maybe global scope
     }
@@ -249,18 +308,275 @@ bool ClassDecl::IsTypeCompatibleWith(NamedType *t)
 bool ClassDecl::IsSubsetOf(NamedType *t)
 {
     bool ss = strcmp(t->id()->name(), id_->name()) == 0;
-    if (!ss && extends_ != NULL && GetClass(extends_) != NULL) {
-        ss = GetClass(extends_)->IsSubsetOf(t);
+    ClassDecl *base = ss || extends_ == NULL ? NULL : GetClass(extends_);
+    if (base != NULL) {
+        ss = base->IsSubsetOf(t);
     }
 
     return ss;
 }
 
+bool ClassDecl::IsSubclassOf(ClassDecl *c)
+{
+    bool sc = (c == this);
+    ClassDecl *base = sc || extends_ == NULL ? NULL : GetClass(extends_);
+    if (base != NULL) {
+        sc = base->IsSubclassOf(c);
+    }
+
+    return sc;
+}
+
+static int RoundUp(int n, int align)
+{
+    return (n + align - 1) / align * align;
+}
+
+void ClassDecl::PlaceField(VarDecl *v)
+{
+    int sz = v->type()->Size();
+    int al = v->type()->Alignment();
+    int off = -1;
+
+    // First fit into padding left by earlier fields (ours or the base's)
+    for (int i = 0; off < 0 && i < holes_->NumElements(); i++) {
+        Hole h = holes_->Nth(i);
+        int start = RoundUp(h.offset, al);
+        if (start + sz <= h.offset + h.size) {
+            Hole before = {h.offset, start - h.offset};
+            Hole after = {start + sz, h.offset + h.size - start - sz};
+            holes_->RemoveAt(i);
+            if (after.size > 0) holes_->InsertAt(after, i);
+            if (before.size > 0) holes_->InsertAt(before, i);
+            off = start;
+        }
+    }
+    if (off < 0) {
+        off = RoundUp(dsize_, al);
+        if (off > dsize_) {
+            Hole pad = {dsize_, off - dsize_};
+            holes_->Append(pad);
+        }
+        dsize_ = off + sz;
+    }
+    if (al > align_) {
+        align_ = al;
+    }
+    v->set_offset(off);
+
+    // keep fields_ sorted by offset for the dump
+    int at = fields_->NumElements();
+    while (at > 0 && fields_->Nth(at - 1)->offset() > off) {
+        at--;
+    }
+    fields_->InsertAt(v, at);
+
+    return;
+}
+
+void ClassDecl::LayoutFields(ClassDecl *base)
+{
+    List<VarDecl*> own;
+
+    if (base != NULL) {
+        // inherited fields keep their offsets
+        dsize_ = base->dsize_;
+        align_ = base->align_;
+        holes_->AppendAll(*base->holes_);
+        fields_->AppendAll(*base->fields_);
+    } else {
+        dsize_ = align_ = Type::wordSize; // vtable pointer at offset 0
+    }
+
+    // Pack by decreasing alignment rather than declaration order; the
+    // insertion is stable so equal-sized fields keep source order.
+    for (Decl *member : *members_) {
+        VarDecl *v = dynamic_cast<VarDecl*>(member);
+        if (v != NULL) {
+            int at = own.NumElements();
+            while (at > 0 && own.Nth(at - 1)->type()->Alignment() <
+                             v->type()->Alignment()) {
+                at--;
+            }
+            own.InsertAt(v, at);
+        }
+    }
+    for (VarDecl *v : own) {
+        PlaceField(v);
+    }
+    size_ = RoundUp(dsize_, align_);
+
+    return;
+}
+
+void ClassDecl::LayoutVtable(ClassDecl *base)
+{
+    if (base != NULL) {
+        vtable_->AppendAll(*base->vtable_);
+    }
+    for (Decl *member : *members_) {
+        FnDecl *f = dynamic_cast<FnDecl*>(member);
+        if (f == NULL) {
+            continue;
+        }
+        FnDecl *inherited = base == NULL ? NULL :
+                            base->GetMemberFn(f->id()->name());
+        if (inherited != NULL) {
+            // an override reuses the slot of the method it replaces
+            f->set_slot(inherited->slot());
+            vtable_->RemoveAt(f->slot());
+            vtable_->InsertAt(f, f->slot());
+        } else {
+            f->set_slot(vtable_->NumElements());
+            vtable_->Append(f);
+        }
+    }
+
+    return;
+}
+
+void ClassDecl::LayoutItables(ClassDecl *base)
+{
+    if (base != NULL) {
+        interfaces_->AppendAll(*base->interfaces_);
+    }
+    for (NamedType *impl : *implements_) {
+        InterfaceDecl *intf = GetInterface(impl);
+        bool seen = false;
+        for (int j = 0; !seen && j < interfaces_->NumElements(); j++) {
+            seen = interfaces_->Nth(j) == intf;
+        }
+        if (intf != NULL && !seen) {
+            interfaces_->Append(intf);
+        }
+    }
+
+    // The itable directory is indexed by interface number, so an
+    // interface call is vtable -> directory[number] -> slot, with no
+    // search. It only extends to the highest number this class needs.
+    for (InterfaceDecl *intf : *interfaces_) {
+        List<FnDecl*> *itable = new List<FnDecl*>;
+        List<Decl*> *methods = intf->members();
+        itable->Reserve(methods->NumElements());
+        for (Decl *method : *methods) {
+            itable->Append(GetMemberFn(method->id()->name()));
+        }
+        while (itables_->NumElements() <= intf->number()) {
+            itables_->Append(NULL);
+        }
+        itables_->RemoveAt(intf->number());
+        itables_->InsertAt(itable, intf->number());
+    }
+
+    return;
+}
+
+void ClassDecl::PrintLayout(void)
+{
+    if (!IsDebugOn("layout")) {
+        return;
+    }
+    int used = Type::wordSize; // vtable pointer
+    for (VarDecl *field : *fields_) {
+        used += field->type()->Size();
+    }
+    PrintDebug("layout", "class %s: size %d, align %d, padding %d",
+               id_->name(), size_, align_, size_ - used);
+    for (VarDecl *v : *fields_) {
+        PrintDebug("layout", "  @%-3d %s %s", v->offset(),
+                   v->type()->name(), v->id()->name());
+    }
+    for (int i = 0; i < vtable_->NumElements(); i++) {
+        FnDecl *f = vtable_->Nth(i);
+        Decl *owner = dynamic_cast<Decl*>(f->parent());
+        PrintDebug("layout", "  vtable[%d] %s.%s", i,
+                   owner->id()->name(), f->id()->name());
+    }
+    for (InterfaceDecl *intf : *interfaces_) {
+        List<FnDecl*> *itable = itables_->Nth(intf->number());
+        for (int j = 0; j < itable->NumElements(); j++) {
+            PrintDebug("layout", "  itable[%d] %s[%d] -> vtable[%d]",
+                       intf->number(), intf->id()->name(), j,
+                       itable->Nth(j)->slot());
+        }
+    }
+
+    return;
+}
+
+void ClassDecl::Layout(void)
+{
+    if (laid_out_) {
+        return;
+    }
+    laid_out_ = true;
+
+    ClassDecl *base = extends_ == NULL ? NULL : GetClass(extends_);
+    if (base != NULL) {
+        base->Layout();
+    }
+    LayoutFields(base);
+    LayoutVtable(base);
+    LayoutItables(base);
+    PrintLayout();
+    PrintGcMap();
+
+    return;
+}
+
+void ClassDecl::GetReferenceOffsets(List<int> *offsets)
+{
+    for (VarDecl *field : *fields_) {
+        if (field->type()->IsReference()) {
+            offsets->Append(field->offset());
+        }
+    }
+
+    return;
+}
+
+void ClassDecl::PrintGcMap(void)
+{
+    if (!IsDebugOn("gcmaps")) {
+        return;
+    }
+
+    List<int> refs;
+    std::string map;
+    char buf[16];
+    GetReferenceOffsets(&refs);
+    for (int ref : refs) {
+        sprintf(buf, " @%d", ref);
+        map += buf;
+    }
+    PrintDebug("gcmaps", "class %s: %d bytes, references at:%s",
+               id_->name(), size_, refs.NumElements() == 0 ? " none" :
+               map.c_str());
+
+    return;
+}
+
+int ClassDecl::size(void)
+{
+    return size_;
+}
+
+List<FnDecl*> *ClassDecl::vtable(void)
+{
+    return vtable_;
+}
+
+List<FnDecl*> *ClassDecl::itable(InterfaceDecl *i)
+{
+    int n = i->number();
+
+    return n < itables_->NumElements() ? itables_->Nth(n) : NULL;
+}
+
 void InterfaceDecl::DoCheck(void)
 {
     // (1) Conflicting declaration check
-    for (int i = 0; i < members_->NumElements(); i++) {
-        Decl *newdecl = members_->Nth(i);
+    for (Decl *newdecl : *members_) {
         char *name = newdecl->id()->name();
         Decl *olddecl = sym_table_->Lookup(name);
         if (olddecl == NULL) {
@@ -272,8 +588,8 @@ void InterfaceDecl::DoCheck(void)
 
     // Check should always follow construction of the symbol table,
     // otherwise any forward declaration will fail.
-    for (int i = 0; i < members_->NumElements(); i++) {
-        members_->Nth(i)->Check();
+    for (Decl *member : *members_) {
+        member->Check();
     }
 
     return;
@@ -285,23 +601,66 @@ InterfaceDecl::InterfaceDecl(Identifier *name, List<Decl*> *members) :
     Assert(name != NULL && members != NULL);
     (members_ = members)->set_parent_all(this);
     sym_table_ = new Hashtable<Decl*>;
+    number_ = -1;
 
     return;
 }
 
+int InterfaceDecl::Save(AstWriter *w)
+{
+    int id = w->Save(id_);
+    int members = w->SaveList(members_);
+    int r = w->Begin(AstInterfaceDecl, NULL);
+    w->Put(id);
+    w->Put(members);
+
+    return r;
+}
+
 Hashtable<Decl*> *InterfaceDecl::sym_table(void)
 {
     return sym_table_;
 }
 
+List<Decl*> *InterfaceDecl::members(void)
+{
+    return members_;
+}
+
+void InterfaceDecl::GetChildren(List<Node*> *children)
+{
+    for (Decl *member : *members_) {
+        children->Append(member);
+    }
+
+    return;
+}
+
+void InterfaceDecl::Layout(int number)
+{
+    number_ = number;
+    for (int i = 0; i < members_->NumElements(); i++) {
+        dynamic_cast<FnDecl*>(members_->Nth(i))->set_slot(i);
+    }
+
+    return;
+}
+
+int InterfaceDecl::number(void)
+{
+    return number_;
+}
+
 FnDecl *InterfaceDecl::GetMemberFn(char *n)
 {
+    Count(LookupCasts);
     return dynamic_cast<FnDecl*>(sym_table_->Lookup(n));
 }
 
 FnDecl *InterfaceDecl::GetFn(Identifier *i)
 {
     FnDecl *memFn = GetMemberFn(i->name());
+    Count(FnHops);
     if (memFn == NULL) {
         memFn = parent()->GetFn(i); // global function
     }
@@ -315,8 +674,7 @@ void FnDecl::DoCheck(void)
     return_type_->Check();
 
     // (1) Conflicting declaration check
-    for (int i = 0; i < formals_->NumElements(); i++) {
-        Decl *newdecl = formals_->Nth(i);
+    for (Decl *newdecl : *formals_) {
         char *name = newdecl->id()->name();
         Decl *olddecl = sym_table_->Lookup(name);
         if (olddecl == NULL) {
@@ -328,8 +686,8 @@ void FnDecl::DoCheck(void)
 
     // Check should always follow construction of the symbol table,
     // otherwise any forward declaration will fail.
-    for (int i = 0; i < formals_->NumElements(); i++) {
-        formals_->Nth(i)->Check();
+    for (VarDecl *formal : *formals_) {
+        formal->Check();
     }
 
     if (body_ != NULL) {
@@ -351,11 +709,32 @@ FnDecl::FnDecl(Identifier *n, Type *ret, List<VarDecl*> *form) :
     (return_type_ = ret)->set_parent(this);
     (formals_ = form)->set_parent_all(this);
     body_ = NULL;
+    slot_ = -1;
     sym_table_ = new Hashtable<Decl*>;
+    escape_summary_ = NULL;
+    summarizing_ = false;
+    frame_size_ = 0;
+    frequency_ = 0;
+    tier_ = 1;
 
     return;
 }
 
+int FnDecl::Save(AstWriter *w)
+{
+    int id = w->Save(id_);
+    int ret = w->Save(return_type_);
+    int formals = w->SaveList(formals_);
+    int body = w->Save(w->signatures_only() ? NULL : body_);
+    int r = w->Begin(AstFnDecl, NULL);
+    w->Put(id);
+    w->Put(ret);
+    w->Put(formals);
+    w->Put(body);
+
+    return r;
+}
+
 Type *FnDecl::return_type(void)
 {
     return return_type_;
@@ -366,6 +745,23 @@ List<VarDecl*> *FnDecl::formals(void)
     return formals_;
 }
 
+Stmt *FnDecl::body(void)
+{
+    return body_;
+}
+
+void FnDecl::GetChildren(List<Node*> *children)
+{
+    for (VarDecl *formal : *formals_) {
+        children->Append(formal);
+    }
+    if (body_ != NULL) {
+        children->Append(body_);
+    }
+
+    return;
+}
+
 void FnDecl::set_body(Stmt *b)
 {
     (body_ = b)->set_parent(this);
@@ -373,21 +769,34 @@ void FnDecl::set_body(Stmt *b)
     return;
 }
 
-ClassDecl *FnDecl::GetClass(NamedType *t)
+int FnDecl::slot(void)
+{
+    return slot_;
+}
+
+void FnDecl::set_slot(int s)
+{
+    slot_ = s;
+
+    return;
+}
+
+Decl *FnDecl::GetTypeDecl(NamedType *t)
 {
     Decl *d = sym_table_->Lookup(t->id()->name());
-    ClassDecl *r = dynamic_cast<ClassDecl*>(d);
     if (d == NULL) {
-        r = parent()->GetClass(t); // maybe global scope
+        d = parent()->GetTypeDecl(t); // maybe global scope
     }
 
-    return r;
+    return d;
 }
 
 VarDecl *FnDecl::GetVar(Identifier *i)
 {
     Decl *d = sym_table_->Lookup(i->name());
     VarDecl *r = dynamic_cast<VarDecl*>(d);
+    Count(VarHops);
+    Count(LookupCasts);
     if (d == NULL) {
         r = parent()->GetVar(i); // maybe global scope
     }
@@ -395,26 +804,314 @@ VarDecl *FnDecl::GetVar(Identifier *i)
     return r;
 }
 
-InterfaceDecl *FnDecl::GetInterface(NamedType *t)
+FnDecl *FnDecl::GetFn(Identifier *i)
 {
-    Decl *d = sym_table_->Lookup(t->id()->name());
-    InterfaceDecl *r = dynamic_cast<InterfaceDecl*>(d);
+    Decl *d = sym_table_->Lookup(i->name());
+    FnDecl *r = dynamic_cast<FnDecl*>(d);
+    Count(FnHops);
+    Count(LookupCasts);
     if (d == NULL) {
-        r = parent()->GetInterface(t); // maybe global scope
+        r = parent()->GetFn(i); // maybe global scope
     }
 
     return r;
 }
 
-FnDecl *FnDecl::GetFn(Identifier *i)
+const char *FnDecl::GetQualifiedName(void)
 {
-    Decl *d = sym_table_->Lookup(i->name());
-    FnDecl *r = dynamic_cast<FnDecl*>(d);
-    if (d == NULL) {
-        r = parent()->GetFn(i); // maybe global scope
+    Decl *owner = dynamic_cast<Decl*>(parent());
+
+    if (qualified_name_.empty()) {
+        qualified_name_ = id_->name();
+        if (dynamic_cast<Program*>(parent()) == NULL && owner != NULL) {
+            qualified_name_ = std::string(owner->id()->name()) + "." +
+                              qualified_name_;
+        }
     }
 
-    return r;
+    return qualified_name_.c_str();
+}
+
+static int CountBoundsChecks(Node *n)
+{
+    ArrayAccess *aa = dynamic_cast<ArrayAccess*>(n);
+    int count = (aa != NULL && aa->bounds_check()) ? 1 : 0;
+
+    List<Node*> children;
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        count += CountBoundsChecks(child);
+    }
+
+    return count;
+}
+
+static void AnalyzeAllocations(Node *n, FnDecl *fn)
+{
+    static const char *kinds[] = {"heap", "stack", "scalars"};
+    NewExpr *ne = dynamic_cast<NewExpr*>(n);
+    NewArrayExpr *na = dynamic_cast<NewArrayExpr*>(n);
+
+    if (ne != NULL) {
+        ne->AnalyzeEscape();
+        PrintDebug("escape", "line %d: New in %s: %s",
+                   ne->location()->first_line, fn->GetQualifiedName(),
+                   kinds[ne->allocation()]);
+    } else if (na != NULL) {
+        na->AnalyzeEscape();
+        PrintDebug("escape", "line %d: NewArray in %s: %s",
+                   na->location()->first_line, fn->GetQualifiedName(),
+                   kinds[na->allocation()]);
+    }
+
+    List<Node*> children;
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        AnalyzeAllocations(child, fn);
+    }
+
+    return;
+}
+
+static void CollectLocals(Node *n, List<VarDecl*> *locals)
+{
+    if (dynamic_cast<VarDecl*>(n) != NULL) {
+        locals->Append(dynamic_cast<VarDecl*>(n));
+    }
+
+    List<Node*> children;
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        CollectLocals(child, locals);
+    }
+
+    return;
+}
+
+void FnDecl::LayoutFrame(void)
+{
+    // Arguments sit above the frame pointer, the receiver first for
+    // methods; locals go below the saved return address and fp.
+    int off = Type::wordSize;
+    if (dynamic_cast<ClassDecl*>(parent()) != NULL) {
+        off += Type::wordSize; // this
+    }
+    for (VarDecl *v : *formals_) {
+        off = RoundUp(off, v->type()->Alignment());
+        v->set_offset(off);
+        off += v->type()->Size();
+    }
+
+    List<VarDecl*> locals;
+    CollectLocals(body_, &locals);
+    frame_size_ = 2 * Type::wordSize;
+    for (VarDecl *v : locals) {
+        frame_size_ = RoundUp(frame_size_ + v->type()->Size(),
+                              v->type()->Alignment());
+        v->set_offset(-frame_size_);
+    }
+
+    return;
+}
+
+static int CountWriteBarriers(Node *n)
+{
+    AssignExpr *a = dynamic_cast<AssignExpr*>(n);
+    int count = 0;
+
+    if (a != NULL) {
+        a->AnalyzeWriteBarrier();
+        count += a->write_barrier() ? 1 : 0;
+    }
+
+    List<Node*> children;
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        count += CountWriteBarriers(child);
+    }
+
+    return count;
+}
+
+void FnDecl::PrintGcMap(int barriers)
+{
+    // The stack map is the same at every safepoint (call, allocation,
+    // loop back edge): locals are not tracked for liveness, so the
+    // prologue must clear every reference slot.
+    if (!IsDebugOn("gcmaps")) {
+        return;
+    }
+
+    List<VarDecl*> locals;
+    std::string map;
+    char buf[64];
+    if (dynamic_cast<ClassDecl*>(parent()) != NULL) {
+        sprintf(buf, " fp+%d(this)", Type::wordSize);
+        map += buf;
+    }
+    locals.AppendAll(*formals_);
+    CollectLocals(body_, &locals);
+    for (VarDecl *v : locals) {
+        if (v->type()->IsReference()) {
+            sprintf(buf, " fp%+d(%s)", v->offset(), v->id()->name());
+            map += buf;
+        }
+    }
+    PrintDebug("gcmaps", "%s: frame %d bytes, %d write barrier%s, "
+               "references at:%s", GetQualifiedName(), frame_size_,
+               barriers, barriers == 1 ? "" : "s",
+               map.empty() ? " none" : map.c_str());
+
+    return;
+}
+
+// Optimize the loops below n, innermost first so that code hoisted out
+// of an inner loop can be considered again by the one around it. Only
+// loops whose body is estimated to run at least hot times qualify; a
+// loop is taken to iterate ten times. Returns the loops optimized.
+static int OptimizeLoops(Node *n, FnDecl *fn, double weight, int hot)
+{
+    List<Node*> children;
+    LoopStmt *loop = dynamic_cast<LoopStmt*>(n);
+    int optimized = 0;
+
+    if (loop != NULL) {
+        weight *= 10;
+    }
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        optimized += OptimizeLoops(child, fn, weight, hot);
+    }
+    if (loop != NULL && weight >= hot) {
+        int hoisted, reduced;
+        yyltype *loc = loop->GetTest()->location();
+        loop->HoistInvariants(&hoisted, &reduced);
+        PrintDebug("licm", "%s: loop at line %d: %d hoisted, "
+                   "%d strength-reduced", fn->GetQualifiedName(),
+                   loc == NULL ? 0 : loc->first_line, hoisted, reduced);
+
+        ForStmt *counted = dynamic_cast<ForStmt*>(loop);
+        const char *why = (counted == NULL ? "not a for loop" :
+                           counted->Vectorize());
+        if (why == NULL) {
+            int lanes = counted->lanes();
+            PrintDebug("vectorize", "%s: loop at line %d: vectorized, "
+                       "%d lanes (AVX2) or %d (SSE2)",
+                       fn->GetQualifiedName(),
+                       loc == NULL ? 0 : loc->first_line, lanes, lanes / 2);
+        } else {
+            PrintDebug("vectorize", "%s: loop at line %d: not vectorized, "
+                       "%s", fn->GetQualifiedName(),
+                       loc == NULL ? 0 : loc->first_line, why);
+        }
+        optimized++;
+    }
+
+    return optimized;
+}
+
+void FnDecl::Optimize(int hot)
+{
+    if (body_ == NULL) {
+        return;
+    }
+
+    LayoutFrame();
+    PrintGcMap(CountWriteBarriers(body_));
+
+    int checks = CountBoundsChecks(body_);
+    int removed = body_->EliminateBoundsChecks();
+    if (checks > 0) {
+        PrintDebug("bce", "%s: removed %d of %d array bounds checks",
+                   GetQualifiedName(), removed, checks);
+    }
+    AnalyzeAllocations(body_, this);
+    if (OptimizeLoops(body_, this, frequency_, hot) > 0 || frequency_ >= hot) {
+        tier_ = 2;
+    }
+
+    return;
+}
+
+double FnDecl::frequency(void)
+{
+    return frequency_;
+}
+
+void FnDecl::set_frequency(double f)
+{
+    frequency_ = f;
+
+    return;
+}
+
+int FnDecl::tier(void)
+{
+    return tier_;
+}
+
+// Does this, explicit or implied by a bare method call, escape below n?
+static bool ThisEscapesIn(Node *n)
+{
+    This *th = dynamic_cast<This*>(n);
+    Call *c = dynamic_cast<Call*>(n);
+
+    if (th != NULL && th->ValueEscapes(true)) {
+        return true;
+    }
+    if (c != NULL && c->GetBase() == NULL && c->dispatch() == VirtualCall &&
+        c->ReceiverEscapes()) {
+        return true;
+    }
+
+    List<Node*> children;
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        if (ThisEscapesIn(child)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void FnDecl::Summarize(void)
+{
+    List<bool> *summary = new List<bool>;
+
+    summarizing_ = true;
+    summary->Append(body_ == NULL || ThisEscapesIn(body_));
+    for (VarDecl *formal : *formals_) {
+        summary->Append(body_ == NULL || Expr::VarEscapes(formal));
+    }
+    summarizing_ = false;
+    escape_summary_ = summary;
+
+    return;
+}
+
+bool FnDecl::ThisEscapes(void)
+{
+    if (summarizing_) {
+        return true;
+    }
+    if (escape_summary_ == NULL) {
+        Summarize();
+    }
+
+    return escape_summary_->Nth(0);
+}
+
+bool FnDecl::FormalEscapes(int n)
+{
+    if (summarizing_) {
+        return true;
+    }
+    if (escape_summary_ == NULL) {
+        Summarize();
+    }
+
+    return escape_summary_->Nth(n + 1);
 }
 
 bool FnDecl::IsSigEquivalentTo(FnDecl *other)
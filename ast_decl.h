@@ -8,6 +8,7 @@
 #include "ast_expr.h"
 #include "hashtable.h"
 #include "list.h"
+#include <string>
 
 class Identifier;
 class Stmt;
@@ -29,21 +30,51 @@ class VarDecl : public Decl
 {
     protected:
         Type *type_;
+        // Byte offset of a field within its object, or of a formal or
+        // local relative to the frame pointer; -1 until assigned.
+        int offset_;
 
         void DoCheck(void);
 
     public:
         VarDecl(Identifier *name, Type *type);
+        int Save(AstWriter *w);
 
         Type *type(void);
+        int offset(void);
+        void set_offset(int off);
+
+        // Formals and block locals, as opposed to fields and globals
+        bool IsLocal(void);
 };
 
 class ClassDecl : public Decl
 {
     private:
+        // An unused byte range inside the object, left over by alignment.
+        struct Hole {
+            int offset, size;
+        };
+
         Hashtable<Decl*> *sym_table_;
 
+        // Object layout, filled in by Layout() after a clean check
+        bool laid_out_;
+        int dsize_;                     // bytes in use, before tail padding
+        int size_, align_;
+        List<Hole> *holes_;
+        List<VarDecl*> *fields_;        // all fields, by offset
+        List<FnDecl*> *vtable_;         // all methods, by slot
+        List<InterfaceDecl*> *interfaces_; // implemented, incl. inherited
+        List<List<FnDecl*>*> *itables_; // indexed by interface number
+
         void MergeSymbolTable(ClassDecl *base);
+        void PlaceField(VarDecl *v);
+        void LayoutFields(ClassDecl *base);
+        void LayoutVtable(ClassDecl *base);
+        void LayoutItables(ClassDecl *base);
+        void PrintLayout(void);
+        void PrintGcMap(void);
 
     protected:
         List<Decl*> *members_;
@@ -55,24 +86,36 @@ class ClassDecl : public Decl
     public:
         ClassDecl(Identifier *n, NamedType *ext,
                   List<NamedType*> *impl, List<Decl*> *memb);
+        int Save(AstWriter *w);
 
         Hashtable<Decl*> *sym_table(void);
+        void GetChildren(List<Node*> *children);
 
         ClassDecl *GetCurrentClass(void);
-        ClassDecl *GetClass(NamedType *t);
+        Decl *GetTypeDecl(NamedType *t);
         VarDecl *GetMemberVar(char *name);
         VarDecl *GetVar(Identifier *i);
-        InterfaceDecl *GetInterface(NamedType *t);
         FnDecl *GetMemberFn(char *name);
         FnDecl *GetFn(Identifier *i);
         bool IsTypeCompatibleWith(NamedType *baseClass);
         bool IsSubsetOf(NamedType *t);
+        bool IsSubclassOf(ClassDecl *c); // true for c itself
+
+        // Assign field offsets, vtable slots and itables. Base classes
+        // are laid out first so inherited members keep their positions.
+        void Layout(void);
+        int size(void);
+        // Offsets the collector must trace in an instance
+        void GetReferenceOffsets(List<int> *offsets);
+        List<FnDecl*> *vtable(void);
+        List<FnDecl*> *itable(InterfaceDecl *i); // NULL if not implemented
 };
 
 class InterfaceDecl : public Decl
 {
     private:
         Hashtable<Decl*> *sym_table_;
+        int number_; // index into every class's itable directory
 
     protected:
         List<Decl*> *members_;
@@ -80,8 +123,15 @@ class InterfaceDecl : public Decl
 
     public:
         InterfaceDecl(Identifier *name, List<Decl*> *members);
+        int Save(AstWriter *w);
 
         Hashtable<Decl*> *sym_table(void);
+        List<Decl*> *members(void);
+        void GetChildren(List<Node*> *children);
+
+        // Number the interface and give each method its itable slot
+        void Layout(int number);
+        int number(void);
 
         FnDecl *GetMemberFn(char *name);
         FnDecl *GetFn(Identifier *i);
@@ -91,26 +141,55 @@ class FnDecl : public Decl
 {
     private:
         Hashtable<Decl*> *sym_table_;
+        // Escape summary for callers: [0] is this, [i+1] formal i
+        List<bool> *escape_summary_;
+        bool summarizing_;
+        int frame_size_; // bytes of locals below the frame pointer
+        double frequency_; // estimated calls per run of the program
+        int tier_;         // 1 baseline, 2 optimized
+        std::string qualified_name_;
+
+        void Summarize(void);
+        void LayoutFrame(void);
+        void PrintGcMap(int barriers);
 
     protected:
         List<VarDecl*> *formals_;
         Type *return_type_;
         Stmt *body_;
+        int slot_; // vtable slot for methods, itable slot in interfaces
         void DoCheck(void);
         FnDecl *GetCurrentFn(void);
 
     public:
         FnDecl(Identifier *n, Type *ret, List<VarDecl*> *form);
+        int Save(AstWriter *w);
 
         Type *return_type(void);
         List<VarDecl*> *formals(void);
+        Stmt *body(void);
         void set_body(Stmt *b);
+        void GetChildren(List<Node*> *children);
+        int slot(void);
+        void set_slot(int s);
 
-        ClassDecl *GetClass(NamedType *t);
+        Decl *GetTypeDecl(NamedType *t);
         VarDecl *GetVar(Identifier *i);
-        InterfaceDecl *GetInterface(NamedType *t);
         FnDecl *GetFn(Identifier *i);
         bool IsSigEquivalentTo(FnDecl *other);
+        const char *GetQualifiedName(void); // Class.method or function
+
+        // Per-function analyses; run on a checked and laid out program.
+        // Loops estimated to run at least hot times get the loop
+        // optimizations, which puts the function in tier 2.
+        void Optimize(int hot);
+        double frequency(void);
+        void set_frequency(double f);
+        int tier(void);
+        // Whether an object passed as receiver or as formal n may be
+        // retained beyond the call. Recursive cycles answer true.
+        bool ThisEscapes(void);
+        bool FormalEscapes(int n);
         void CheckCallCompatibility(Identifier *caller,
                                     List<Expr*> *actuals);
 
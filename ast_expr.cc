@@ -3,7 +3,10 @@
 #include "ast_expr.h"
 #include "ast_type.h"
 #include "ast_decl.h"
+#include "astcache.h"
+#include "xref.h"
 #include <string.h>
+#include <limits.h>
 #include "errors.h"
 
 /*** class Expr ******************************************************/
@@ -11,6 +14,8 @@
 Expr::Expr(yyltype loc) : Stmt(loc)
 {
     type_ = NULL;
+    folded_ = NULL;
+    hoisted_ = reduced_ = false;
 
     return;
 }
@@ -18,6 +23,8 @@ Expr::Expr(yyltype loc) : Stmt(loc)
 Expr::Expr(void) : Stmt()
 {
     type_ = NULL;
+    folded_ = NULL;
+    hoisted_ = reduced_ = false;
 
     return;
 }
@@ -27,6 +34,154 @@ Type *Expr::type(void)
     return type_;
 }
 
+Expr *Expr::Folded(void)
+{
+    return folded_ == NULL ? this : folded_;
+}
+
+bool Expr::hoisted(void)
+{
+    return hoisted_;
+}
+
+void Expr::MarkHoisted(void)
+{
+    hoisted_ = true;
+
+    return;
+}
+
+bool Expr::reduced(void)
+{
+    return reduced_;
+}
+
+void Expr::MarkReduced(void)
+{
+    reduced_ = true;
+
+    return;
+}
+
+// Reads of local v below n; writes are found through their parent
+static void CollectUses(Node *n, VarDecl *v, List<FieldAccess*> *uses)
+{
+    FieldAccess *fa = dynamic_cast<FieldAccess*>(n);
+    if (fa != NULL && fa->GetBase() == NULL && fa->var() == v) {
+        uses->Append(fa);
+    }
+
+    List<Node*> children;
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        CollectUses(child, v, uses);
+    }
+
+    return;
+}
+
+bool Expr::VarEscapes(VarDecl *v)
+{
+    List<VarDecl*> seen;
+
+    return VarEscapes(v, true, &seen);
+}
+
+bool Expr::VarEscapes(VarDecl *v, bool viaCalls, List<VarDecl*> *seen)
+{
+    if (!v->IsLocal() || v->GetCurrentFn()->body() == NULL) {
+        return true;
+    }
+    for (VarDecl *looking : *seen) {
+        if (looking == v) {
+            return false; // its uses are already being looked at
+        }
+    }
+    seen->Append(v);
+
+    List<FieldAccess*> uses;
+    int stores = 0;
+    CollectUses(v->GetCurrentFn()->body(), v, &uses);
+    for (FieldAccess *u : uses) {
+        AssignExpr *a = dynamic_cast<AssignExpr*>(u->parent());
+        if (a != NULL && a->left() == u) {
+            stores++;
+        } else if (u->ValueEscapes(viaCalls, seen)) {
+            return true;
+        }
+    }
+
+    // Scalar replacement needs v to name one object only
+    return !viaCalls && stores > 1;
+}
+
+bool Expr::ValueEscapes(bool viaCalls)
+{
+    List<VarDecl*> seen;
+
+    return ValueEscapes(viaCalls, &seen);
+}
+
+bool Expr::ValueEscapes(bool viaCalls, List<VarDecl*> *seen)
+{
+    Node *p = parent();
+    FieldAccess *fa = dynamic_cast<FieldAccess*>(p);
+    ArrayAccess *aa = dynamic_cast<ArrayAccess*>(p);
+    Call *c = dynamic_cast<Call*>(p);
+    AssignExpr *a = dynamic_cast<AssignExpr*>(p);
+
+    if ((fa != NULL && fa->GetBase() == this) ||
+        (aa != NULL && aa->base() == this)) {
+        return false; // only its contents are touched
+    }
+    if (dynamic_cast<EqualityExpr*>(p) != NULL) {
+        return !viaCalls; // compared by address
+    }
+    if (c != NULL && c->GetBase() == this) {
+        return (c->dispatch() != ArrayLengthCall &&
+                (!viaCalls || c->ReceiverEscapes()));
+    }
+    if (c != NULL) {
+        List<Expr*> *actuals = c->GetActuals();
+        for (int i = 0; i < actuals->NumElements(); i++) {
+            if (actuals->Nth(i) == this) {
+                return !viaCalls || c->ActualEscapes(i);
+            }
+        }
+    }
+    if (a != NULL && a->right() == this) {
+        FieldAccess *lhs = dynamic_cast<FieldAccess*>(a->left());
+        VarDecl *v = lhs == NULL || lhs->GetBase() != NULL ? NULL :
+                     lhs->var();
+        if (v == NULL || !v->IsLocal() ||
+            (!viaCalls && seen->NumElements() > 0)) {
+            return true; // stored to the heap, or aliased
+        }
+        return (VarEscapes(v, viaCalls, seen) ||
+                a->ValueEscapes(viaCalls, seen));
+    }
+
+    // An expression statement discards its value; anything else, such
+    // as a return or a store through an lvalue, lets it escape.
+    return (dynamic_cast<Expr*>(p) != NULL ||
+            dynamic_cast<ReturnStmt*>(p) != NULL ||
+            dynamic_cast<PrintStmt*>(p) != NULL);
+}
+
+static bool InsideLoop(Node *n)
+{
+    for (Node *p = n->parent(); p != NULL; p = p->parent()) {
+        if (dynamic_cast<LoopStmt*>(p) != NULL) {
+            return true;
+        }
+        if (dynamic_cast<FnDecl*>(p) != NULL) {
+            break;
+        }
+    }
+
+    return false;
+}
+
 /*** class EmptyExpr ***********************************************/
 
 EmptyExpr::EmptyExpr(void) : Expr()
@@ -36,6 +191,11 @@ EmptyExpr::EmptyExpr(void) : Expr()
     return;
 }
 
+int EmptyExpr::Save(AstWriter *w)
+{
+    return w->Begin(AstEmptyExpr, location_);
+}
+
 /*** class IntConstant ***********************************************/
 
 IntConstant::IntConstant(yyltype loc, int val) : Expr(loc)
@@ -46,6 +206,19 @@ IntConstant::IntConstant(yyltype loc, int val) : Expr(loc)
     return;
 }
 
+int IntConstant::Save(AstWriter *w)
+{
+    int r = w->Begin(AstIntConstant, location_);
+    w->Put(value_);
+
+    return r;
+}
+
+int IntConstant::value(void)
+{
+    return value_;
+}
+
 /*** class DoubleConstant ********************************************/
 
 DoubleConstant::DoubleConstant(yyltype loc, double val) : Expr(loc)
@@ -56,6 +229,19 @@ DoubleConstant::DoubleConstant(yyltype loc, double val) : Expr(loc)
     return;
 }
 
+int DoubleConstant::Save(AstWriter *w)
+{
+    int r = w->Begin(AstDoubleConstant, location_);
+    w->PutDouble(value_);
+
+    return r;
+}
+
+double DoubleConstant::value(void)
+{
+    return value_;
+}
+
 /*** class BoolConstant **********************************************/
 
 BoolConstant::BoolConstant(yyltype loc, bool val) : Expr(loc)
@@ -66,18 +252,44 @@ BoolConstant::BoolConstant(yyltype loc, bool val) : Expr(loc)
     return;
 }
 
+int BoolConstant::Save(AstWriter *w)
+{
+    int r = w->Begin(AstBoolConstant, location_);
+    w->Put(value_);
+
+    return r;
+}
+
+bool BoolConstant::value(void)
+{
+    return value_;
+}
+
 /*** class StringConstant ********************************************/
 
-StringConstant::StringConstant(yyltype loc, const char *val) :
+StringConstant::StringConstant(yyltype loc, PooledString *val) :
     Expr(loc)
 {
     Assert(val != NULL);
-    value_ = strdup(val);
+    value_ = val;
     type_ = Type::stringType;
 
     return;
 }
 
+int StringConstant::Save(AstWriter *w)
+{
+    int r = w->Begin(AstStringConstant, location_);
+    w->PutString(value_->chars); // interned again when loaded
+
+    return r;
+}
+
+PooledString *StringConstant::value(void)
+{
+    return value_;
+}
+
 /*** class NullConstant **********************************************/
 
 NullConstant::NullConstant(yyltype loc) : Expr(loc)
@@ -87,6 +299,11 @@ NullConstant::NullConstant(yyltype loc) : Expr(loc)
     return;
 }
 
+int NullConstant::Save(AstWriter *w)
+{
+    return w->Begin(AstNullConstant, location_);
+}
+
 /*** class Operator **************************************************/
 
 Operator::Operator(yyltype loc, const char *lexeme) : Node(loc)
@@ -97,6 +314,19 @@ Operator::Operator(yyltype loc, const char *lexeme) : Node(loc)
     return;
 }
 
+int Operator::Save(AstWriter *w)
+{
+    int r = w->Begin(AstOperator, location_);
+    w->PutString(lexeme_);
+
+    return r;
+}
+
+const char *Operator::lexeme(void)
+{
+    return lexeme_;
+}
+
 std::ostream& operator<<(std::ostream& out, Operator *o)
 {
     return out << o->lexeme_;
@@ -108,8 +338,125 @@ void CompoundExpr::OperandCheck(void)
 {
     if (left_ != NULL) {
         left_->Check();
+        left_ = left_->Folded();
     }
     right_->Check();
+    right_ = right_->Folded();
+
+    return;
+}
+
+static bool IsOp(const char *op, const char *lexeme)
+{
+    return strcmp(op, lexeme) == 0;
+}
+
+void CompoundExpr::Fold(void)
+{
+    const char *op = op_->lexeme();
+    IntConstant *li = dynamic_cast<IntConstant*>(left_);
+    IntConstant *ri = dynamic_cast<IntConstant*>(right_);
+    DoubleConstant *ld = dynamic_cast<DoubleConstant*>(left_);
+    DoubleConstant *rd = dynamic_cast<DoubleConstant*>(right_);
+    BoolConstant *lb = dynamic_cast<BoolConstant*>(left_);
+    BoolConstant *rb = dynamic_cast<BoolConstant*>(right_);
+    StringConstant *ls = dynamic_cast<StringConstant*>(left_);
+    StringConstant *rs = dynamic_cast<StringConstant*>(right_);
+    bool nulls = (dynamic_cast<NullConstant*>(left_) != NULL &&
+                  dynamic_cast<NullConstant*>(right_) != NULL);
+    bool eq = IsOp(op, "=="), ne = IsOp(op, "!=");
+    yyltype loc = *location();
+    Expr *result = NULL;
+
+    if (type_ == Type::errorType) {
+        return;
+    }
+    if ((IsOp(op, "/") || IsOp(op, "%")) && ri != NULL && ri->value() == 0) {
+        ReportError::DivisionByZero(right_);
+        return;
+    }
+
+    if (left_ == NULL) {
+        if (ri != NULL && IsOp(op, "-")) {
+            result = new IntConstant(loc, (int)(0u - (unsigned)ri->value()));
+        } else if (rd != NULL && IsOp(op, "-")) {
+            result = new DoubleConstant(loc, -rd->value());
+        } else if (rb != NULL && IsOp(op, "!")) {
+            result = new BoolConstant(loc, !rb->value());
+        }
+    } else if (li != NULL && ri != NULL) {
+        // Decaf ints wrap around in 32 bits
+        unsigned a = li->value(), b = ri->value();
+        int x = li->value(), y = ri->value();
+        bool overflow = (x == INT_MIN && y == -1);
+        if (IsOp(op, "+")) {
+            result = new IntConstant(loc, (int)(a + b));
+        } else if (IsOp(op, "-")) {
+            result = new IntConstant(loc, (int)(a - b));
+        } else if (IsOp(op, "*")) {
+            result = new IntConstant(loc, (int)(a * b));
+        } else if (IsOp(op, "/") && !overflow) {
+            result = new IntConstant(loc, x / y);
+        } else if (IsOp(op, "%") && !overflow) {
+            result = new IntConstant(loc, x % y);
+        } else if (IsOp(op, "<")) {
+            result = new BoolConstant(loc, x < y);
+        } else if (IsOp(op, "<=")) {
+            result = new BoolConstant(loc, x <= y);
+        } else if (IsOp(op, ">")) {
+            result = new BoolConstant(loc, x > y);
+        } else if (IsOp(op, ">=")) {
+            result = new BoolConstant(loc, x >= y);
+        } else if (eq || ne) {
+            result = new BoolConstant(loc, (x == y) == eq);
+        }
+    } else if (ld != NULL && rd != NULL) {
+        double x = ld->value(), y = rd->value();
+        if (IsOp(op, "+")) {
+            result = new DoubleConstant(loc, x + y);
+        } else if (IsOp(op, "-")) {
+            result = new DoubleConstant(loc, x - y);
+        } else if (IsOp(op, "*")) {
+            result = new DoubleConstant(loc, x * y);
+        } else if (IsOp(op, "/")) {
+            result = new DoubleConstant(loc, x / y);
+        } else if (IsOp(op, "<")) {
+            result = new BoolConstant(loc, x < y);
+        } else if (IsOp(op, "<=")) {
+            result = new BoolConstant(loc, x <= y);
+        } else if (IsOp(op, ">")) {
+            result = new BoolConstant(loc, x > y);
+        } else if (IsOp(op, ">=")) {
+            result = new BoolConstant(loc, x >= y);
+        } else if (eq || ne) {
+            result = new BoolConstant(loc, (x == y) == eq);
+        }
+    } else if (lb != NULL && rb != NULL) {
+        bool x = lb->value(), y = rb->value();
+        if (IsOp(op, "&&")) {
+            result = new BoolConstant(loc, x && y);
+        } else if (IsOp(op, "||")) {
+            result = new BoolConstant(loc, x || y);
+        } else if (eq || ne) {
+            result = new BoolConstant(loc, (x == y) == eq);
+        }
+    } else if (lb != NULL && right_->type() == Type::boolType &&
+               ((IsOp(op, "&&") && !lb->value()) ||
+                (IsOp(op, "||") && lb->value()))) {
+        // The right operand is never evaluated
+        result = new BoolConstant(loc, lb->value());
+    } else if (ls != NULL && rs != NULL && (eq || ne)) {
+        result = new BoolConstant(loc,
+                                  StringsEqual(ls->value(), rs->value()) == eq);
+    } else if (nulls && (eq || ne)) {
+        result = new BoolConstant(loc, eq);
+    }
+
+    if (result != NULL) {
+        result->set_parent(parent());
+        result->Check();
+        folded_ = result;
+    }
 
     return;
 }
@@ -136,6 +483,44 @@ CompoundExpr::CompoundExpr(Operator *op, Expr *rhs) :
     return;
 }
 
+int CompoundExpr::SaveAs(AstWriter *w, int kind)
+{
+    int left = w->Save(left_);
+    int op = w->Save(op_);
+    int right = w->Save(right_);
+    int r = w->Begin((AstKind)kind, NULL);
+    w->Put(left);
+    w->Put(op);
+    w->Put(right);
+
+    return r;
+}
+
+Operator *CompoundExpr::op(void)
+{
+    return op_;
+}
+
+Expr *CompoundExpr::left(void)
+{
+    return left_;
+}
+
+Expr *CompoundExpr::right(void)
+{
+    return right_;
+}
+
+void CompoundExpr::GetChildren(List<Node*> *children)
+{
+    if (left_ != NULL) {
+        children->Append(left_);
+    }
+    children->Append(right_);
+
+    return;
+}
+
 /*** class ArithmeticExpr ********************************************/
 
 void ArithmeticExpr::UnaryCheck(void)
@@ -188,6 +573,7 @@ void ArithmeticExpr::DoCheck(void)
     } else {
         BinaryCheck();
     }
+    Fold();
 
     return;
 }
@@ -204,6 +590,11 @@ ArithmeticExpr::ArithmeticExpr(Operator *op, Expr *rhs) :
     return;
 }
 
+int ArithmeticExpr::Save(AstWriter *w)
+{
+    return SaveAs(w, AstArithmeticExpr);
+}
+
 /*** class RelationalExpr ********************************************/
 
 void RelationalExpr::DoCheck(void)
@@ -228,6 +619,7 @@ void RelationalExpr::DoCheck(void)
                                           right_->type());
     }
     type_ = Type::boolType;
+    Fold();
 
     return;
 }
@@ -238,6 +630,11 @@ RelationalExpr::RelationalExpr(Expr *lhs, Operator *op, Expr *rhs) :
     return;
 }
 
+int RelationalExpr::Save(AstWriter *w)
+{
+    return SaveAs(w, AstRelationalExpr);
+}
+
 /*** class EqualityExpr **********************************************/
 
 void EqualityExpr::DoCheck(void)
@@ -249,6 +646,7 @@ void EqualityExpr::DoCheck(void)
                                           right_->type());
     }
     type_ = Type::boolType;
+    Fold();
 
     return;
 }
@@ -259,6 +657,11 @@ EqualityExpr::EqualityExpr(Expr *lhs, Operator *op, Expr *rhs) :
     return;
 }
 
+int EqualityExpr::Save(AstWriter *w)
+{
+    return SaveAs(w, AstEqualityExpr);
+}
+
 const char *EqualityExpr::GetPrintNameForNode(void)
 {
     return "EqualityExpr";
@@ -304,6 +707,7 @@ void LogicalExpr::DoCheck(void)
     } else {
         BinaryCheck();
     }
+    Fold();
 
     return;
 }
@@ -320,6 +724,11 @@ LogicalExpr::LogicalExpr(Operator *op, Expr *rhs) :
     return;
 }
 
+int LogicalExpr::Save(AstWriter *w)
+{
+    return SaveAs(w, AstLogicalExpr);
+}
+
 const char *LogicalExpr::GetPrintNameForNode(void)
 {
     return "LogicalExpr";
@@ -347,6 +756,31 @@ void AssignExpr::DoCheck(void)
 AssignExpr::AssignExpr(Expr *lhs, Operator *op, Expr *rhs) :
     CompoundExpr(lhs, op, rhs)
 {
+    write_barrier_ = false;
+
+    return;
+}
+
+int AssignExpr::Save(AstWriter *w)
+{
+    return SaveAs(w, AstAssignExpr);
+}
+
+bool AssignExpr::write_barrier(void)
+{
+    return write_barrier_;
+}
+
+void AssignExpr::AnalyzeWriteBarrier(void)
+{
+    FieldAccess *fa = dynamic_cast<FieldAccess*>(left_);
+    // locals and globals are roots, which the collector always scans
+    bool heap = (dynamic_cast<ArrayAccess*>(left_) != NULL ||
+                 (fa != NULL && fa->var() != NULL &&
+                  dynamic_cast<ClassDecl*>(fa->var()->parent()) != NULL));
+    write_barrier_ = (heap && right_->type()->IsReference() &&
+                      dynamic_cast<NullConstant*>(right_) == NULL);
+
     return;
 }
 
@@ -357,6 +791,11 @@ const char *AssignExpr::GetPrintNameForNode(void)
 
 /*** class This ******************************************************/
 
+int This::Save(AstWriter *w)
+{
+    return w->Begin(AstThis, location_);
+}
+
 void This::DoCheck(void)
 {
     ClassDecl *c = GetCurrentClass();
@@ -376,6 +815,7 @@ void ArrayAccess::DoCheck(void)
 {
     base_->Check();
     subscript_->Check();
+    subscript_ = subscript_->Folded();
     if (base_->type() == Type::errorType) {
         type_ = Type::errorType;
     } else if (dynamic_cast<ArrayType*>(base_->type()) == NULL) {
@@ -399,6 +839,48 @@ ArrayAccess::ArrayAccess(yyltype loc, Expr *base, Expr *subscript) :
 {
     (base_ = base)->set_parent(this);
     (subscript_ = subscript)->set_parent(this);
+    bounds_check_ = true;
+
+    return;
+}
+
+int ArrayAccess::Save(AstWriter *w)
+{
+    int base = w->Save(base_);
+    int subscript = w->Save(subscript_);
+    int r = w->Begin(AstArrayAccess, location_);
+    w->Put(base);
+    w->Put(subscript);
+
+    return r;
+}
+
+Expr *ArrayAccess::base(void)
+{
+    return base_;
+}
+
+Expr *ArrayAccess::subscript(void)
+{
+    return subscript_;
+}
+
+bool ArrayAccess::bounds_check(void)
+{
+    return bounds_check_;
+}
+
+void ArrayAccess::RemoveBoundsCheck(void)
+{
+    bounds_check_ = false;
+
+    return;
+}
+
+void ArrayAccess::GetChildren(List<Node*> *children)
+{
+    children->Append(base_);
+    children->Append(subscript_);
 
     return;
 }
@@ -412,6 +894,37 @@ FieldAccess::FieldAccess(Expr *b, Identifier *f) :
     base = b;
     if (base) base->set_parent(this);
     (field=f)->set_parent(this);
+    var_ = NULL;
+
+    return;
+}
+
+int FieldAccess::Save(AstWriter *w)
+{
+    int b = w->Save(base);
+    int f = w->Save(field);
+    int r = w->Begin(AstFieldAccess, NULL);
+    w->Put(b);
+    w->Put(f);
+
+    return r;
+}
+
+Expr *FieldAccess::GetBase(void)
+{
+    return base;
+}
+
+VarDecl *FieldAccess::var(void)
+{
+    return var_;
+}
+
+void FieldAccess::GetChildren(List<Node*> *children)
+{
+    if (base != NULL) {
+        children->Append(base);
+    }
 
     return;
 }
@@ -423,6 +936,7 @@ void FieldAccess::UnaryCheck(void)
         ReportError::IdentifierNotDeclared(field, LookingForVariable);
         type_ = Type::errorType;
     } else {
+        var_ = v;
         v->Check();
         type_ = v->type();
     }
@@ -438,6 +952,7 @@ void FieldAccess::NativeAccessCheck(void)
         ReportError::FieldNotFoundInBase(field, base->type());
         type_ = Type::errorType;
     } else {
+        var_ = v;
         v->Check();
         type_ = v->type();
     }
@@ -467,6 +982,7 @@ void FieldAccess::ForeignAccessCheck(void)
                 ReportError::InaccessibleField(field, bt);
                 type_ = Type::errorType;
             } else {
+                var_ = v;
                 type_ = v->type();
             }
         }
@@ -498,6 +1014,11 @@ void FieldAccess::DoCheck(void)
             type_ = Type::errorType;
         }
     }
+    if (var_ != NULL) {
+        AssignExpr *a = dynamic_cast<AssignExpr*>(parent());
+        RecordUse(a != NULL && a->left() == this ? XrefWrite : XrefRead,
+                  var_, field);
+    }
 
     return;
 }
@@ -513,6 +1034,38 @@ Call::Call(yyltype loc, Expr *b, Identifier *f, List<Expr*> *a) :
     }
     (field=f)->set_parent(this);
     (actuals=a)->set_parent_all(this);
+    target_ = NULL;
+    dispatch_ = StaticCall;
+    receiver_ = NULL;
+    candidates_ = new List<FnDecl*>;
+    inlined_ = false;
+    profile_count_ = -1;
+    guarded_target_ = NULL;
+
+    return;
+}
+
+int Call::Save(AstWriter *w)
+{
+    int b = w->Save(base);
+    int f = w->Save(field);
+    int a = w->SaveList(actuals);
+    int r = w->Begin(AstCall, location_);
+    w->Put(b);
+    w->Put(f);
+    w->Put(a);
+
+    return r;
+}
+
+void Call::SetDispatch(dispatchT kind, Decl *receiver)
+{
+    dispatch_ = kind;
+    receiver_ = receiver;
+    if ((kind == VirtualCall || kind == InterfaceCall) &&
+        GetProgram() != NULL) {
+        GetProgram()->AddCallSite(this);
+    }
 
     return;
 }
@@ -520,7 +1073,12 @@ Call::Call(yyltype loc, Expr *b, Identifier *f, List<Expr*> *a) :
 void Call::UnaryCheck(void)
 {
     FnDecl *f = GetFn(field);
+    if (f != NULL && dynamic_cast<ClassDecl*>(f->parent()) != NULL) {
+        // implicit this.func()
+        SetDispatch(VirtualCall, GetCurrentClass());
+    }
     if (f != NULL) {
+        target_ = f;
         f->Check();
         f->CheckCallCompatibility(field, actuals);
         type_ = f->return_type();
@@ -543,6 +1101,7 @@ void Call::BinaryCheck(void)
     } else if (dynamic_cast<ArrayType*>(base->type()) != NULL) {
         // Check array.length()
         if (strcmp(field->name(), "length") == 0) {
+            dispatch_ = ArrayLengthCall;
             CallCheck(new LengthFn(*field->location()));
         } else {
             ReportError::FieldNotFoundInBase(field, base->type());
@@ -550,15 +1109,24 @@ void Call::BinaryCheck(void)
         }
     } else if (dynamic_cast<This*>(base) != NULL) {
         // this.func()
-        CallCheck(GetCurrentClass()->GetMemberFn(field->name()));
+        FnDecl *f = GetCurrentClass()->GetMemberFn(field->name());
+        if (f != NULL) {
+            SetDispatch(VirtualCall, GetCurrentClass());
+        }
+        CallCheck(f);
     } else {
         // var.func()
         NamedType *nt = dynamic_cast<NamedType*>(base->type());
-        ClassDecl *c = nt == NULL ? NULL : GetClass(nt);
-        InterfaceDecl *itf = nt == NULL ? NULL : GetInterface(nt);
+        Decl *d = nt == NULL ? NULL : GetTypeDecl(nt);
+        ClassDecl *c = dynamic_cast<ClassDecl*>(d);
+        InterfaceDecl *itf = dynamic_cast<InterfaceDecl*>(d);
         FnDecl *f = (c != NULL   ? (c->Check(), c->GetMemberFn(field->name())) :
                      itf != NULL ? (itf->Check(), itf->GetMemberFn(field->name())) :
                      /* Else */    NULL);
+        if (f != NULL) {
+            SetDispatch(c != NULL ? VirtualCall : InterfaceCall,
+                        c != NULL ? (Decl*)c : (Decl*)itf);
+        }
         CallCheck(f);
     }
 
@@ -568,6 +1136,7 @@ void Call::BinaryCheck(void)
 void Call::CallCheck(FnDecl *f)
 {
     if (f != NULL) {
+        target_ = f;
         f->Check();
         f->CheckCallCompatibility(field, actuals);
         type_ = f->return_type();
@@ -584,23 +1153,209 @@ void Call::CallCheck(FnDecl *f)
 
 void Call::DoCheck(void)
 {
-    for (int i = 0; i < actuals->NumElements(); i++) {
-        actuals->Nth(i)->Check();
+    for (Expr *&actual : *actuals) {
+        actual->Check();
+        actual = actual->Folded();
     }
     if (base == NULL) {
         UnaryCheck();
     } else {
         BinaryCheck();
     }
+    if (target_ != NULL && dispatch_ != ArrayLengthCall) {
+        RecordUse(XrefCall, target_, field);
+    }
+
+    return;
+}
+
+
+Expr *Call::GetBase(void)
+{
+    return base;
+}
+
+List<Expr*> *Call::GetActuals(void)
+{
+    return actuals;
+}
+
+void Call::GetChildren(List<Node*> *children)
+{
+    if (base != NULL) {
+        children->Append(base);
+    }
+    for (Expr *actual : *actuals) {
+        children->Append(actual);
+    }
+
+    return;
+}
+
+FnDecl *Call::target(void)
+{
+    return target_;
+}
+
+dispatchT Call::dispatch(void)
+{
+    return dispatch_;
+}
+
+List<FnDecl*> *Call::candidates(void)
+{
+    return candidates_;
+}
+
+FnDecl *Call::TargetIn(ClassDecl *c)
+{
+    ClassDecl *rc = dynamic_cast<ClassDecl*>(receiver_);
+    InterfaceDecl *ri = dynamic_cast<InterfaceDecl*>(receiver_);
+
+    if (rc != NULL && c->IsSubclassOf(rc)) {
+        return c->vtable()->Nth(target_->slot());
+    } else if (ri != NULL && c->itable(ri) != NULL) {
+        return c->itable(ri)->Nth(target_->slot());
+    }
+
+    return NULL;
+}
+
+void Call::Classify(List<ClassDecl*> *classes)
+{
+    // Class hierarchy analysis: the targets a receiver-class-keyed
+    // inline cache at this site could ever see.
+    candidates_->Clear();
+    for (ClassDecl *c : *classes) {
+        FnDecl *impl = TargetIn(c);
+        bool seen = (impl == NULL);
+        for (int j = 0; !seen && j < candidates_->NumElements(); j++) {
+            seen = candidates_->Nth(j) == impl;
+        }
+        if (!seen) {
+            candidates_->Append(impl);
+        }
+    }
+
+    int n = candidates_->NumElements();
+    PrintDebug("dispatch", "line %d: %s call %s.%s, %d target%s (%s)",
+               location_->first_line,
+               dispatch_ == InterfaceCall ? "interface" : "virtual",
+               receiver_->id()->name(), field->name(), n,
+               n == 1 ? "" : "s",
+               n <= 1 ? "monomorphic" :
+               n <= maxPolymorphic ? "polymorphic" : "megamorphic");
 
     return;
 }
 
+bool Call::ReceiverEscapes(void)
+{
+    for (FnDecl *candidate : *candidates_) {
+        if (candidate->ThisEscapes()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Call::ActualEscapes(int n)
+{
+    if (dispatch_ == StaticCall) {
+        return target_->FormalEscapes(n);
+    }
+    for (FnDecl *candidate : *candidates_) {
+        if (candidate->FormalEscapes(n)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+FnDecl *Call::DevirtualizedTarget(void)
+{
+    FnDecl *f = NULL;
+
+    if (dispatch_ == StaticCall) {
+        f = target_;
+    } else if (candidates_->NumElements() == 1) {
+        f = candidates_->Nth(0);
+    }
+
+    return f;
+}
+
+bool Call::inlined(void)
+{
+    return inlined_;
+}
+
+void Call::MarkInlined(void)
+{
+    inlined_ = true;
+
+    return;
+}
+
+long Call::profile_count(void)
+{
+    return profile_count_;
+}
+
+void Call::set_profile_count(long n)
+{
+    profile_count_ = n;
+
+    return;
+}
+
+FnDecl *Call::guarded_target(void)
+{
+    return guarded_target_;
+}
+
+void Call::SetGuardedTarget(FnDecl *f)
+{
+    guarded_target_ = f;
+
+    return;
+}
 
 NewExpr::NewExpr(yyltype loc, NamedType *c) : Expr(loc)
 {
     Assert(c != NULL);
     (cType=c)->set_parent(this);
+    alloc_ = HeapAlloc;
+
+    return;
+}
+
+int NewExpr::Save(AstWriter *w)
+{
+    int t = w->Save(cType);
+    int r = w->Begin(AstNewExpr, location_);
+    w->Put(t);
+
+    return r;
+}
+
+allocT NewExpr::allocation(void)
+{
+    return alloc_;
+}
+
+void NewExpr::AnalyzeEscape(void)
+{
+    // A stack slot is reused on every iteration, so an object made in
+    // a loop must not live into the next one. Scalars are renamed per
+    // iteration and have no such problem.
+    if (!ValueEscapes(false)) {
+        alloc_ = ScalarAlloc;
+    } else if (!InsideLoop(this) && !ValueEscapes(true)) {
+        alloc_ = StackAlloc;
+    }
 
     return;
 }
@@ -608,12 +1363,14 @@ NewExpr::NewExpr(yyltype loc, NamedType *c) : Expr(loc)
 
 void NewExpr::DoCheck(void)
 {
-    if (GetClass(cType) == NULL) {
+    ClassDecl *c = GetClass(cType);
+    if (c == NULL) {
         ReportError::IdentifierNotDeclared(cType->id(),
                                            LookingForClass);
         type_ = Type::errorType;
     } else {
         type_ = cType;
+        RecordUse(XrefNew, c, cType->id());
     }
 
     return;
@@ -623,6 +1380,7 @@ void NewExpr::DoCheck(void)
 void NewArrayExpr::DoCheck(void)
 {
     size->Check();
+    size = size->Folded();
     if (size->type() != Type::errorType &&
         size->type() != Type::intType) {
         ReportError::NewArraySizeNotInteger(size);
@@ -642,6 +1400,41 @@ NewArrayExpr::NewArrayExpr(yyltype loc, Expr *sz, Type *et) : Expr(loc)
     Assert(sz != NULL && et != NULL);
     (size=sz)->set_parent(this);
     (elemType=et)->set_parent(this);
+    alloc_ = HeapAlloc;
+
+    return;
+}
+
+int NewArrayExpr::Save(AstWriter *w)
+{
+    int s = w->Save(size);
+    int t = w->Save(elemType);
+    int r = w->Begin(AstNewArrayExpr, location_);
+    w->Put(s);
+    w->Put(t);
+
+    return r;
+}
+
+allocT NewArrayExpr::allocation(void)
+{
+    return alloc_;
+}
+
+void NewArrayExpr::AnalyzeEscape(void)
+{
+    IntConstant *n = dynamic_cast<IntConstant*>(size);
+    if (n != NULL && n->value() >= 0 && n->value() <= maxStackElems &&
+        !InsideLoop(this) && !ValueEscapes(true)) {
+        alloc_ = StackAlloc;
+    }
+
+    return;
+}
+
+void NewArrayExpr::GetChildren(List<Node*> *children)
+{
+    children->Append(size);
 
     return;
 }
@@ -654,6 +1447,11 @@ ReadIntegerExpr::ReadIntegerExpr(yyltype loc) : Expr(loc)
     return;
 }
 
+int ReadIntegerExpr::Save(AstWriter *w)
+{
+    return w->Begin(AstReadIntegerExpr, location_);
+}
+
 
 ReadLineExpr::ReadLineExpr(yyltype loc) : Expr (loc)
 {
@@ -661,3 +1459,8 @@ ReadLineExpr::ReadLineExpr(yyltype loc) : Expr (loc)
 
     return;
 }
+
+int ReadLineExpr::Save(AstWriter *w)
+{
+    return w->Begin(AstReadLineExpr, location_);
+}
@@ -16,20 +16,50 @@
 #include "ast.h"
 #include "ast_stmt.h"
 #include "list.h"
+#include "stringpool.h"
 
 class NamedType; // for new
 class Type; // for NewArray
+class ClassDecl;
+
+typedef enum {StaticCall, VirtualCall, InterfaceCall, ArrayLengthCall} dispatchT;
+typedef enum {HeapAlloc, StackAlloc, ScalarAlloc} allocT;
 
 
 class Expr : public Stmt
 {
     protected:
         Type *type_;
+        Expr *folded_; // literal standing in for a constant expression
+        bool hoisted_, reduced_;
+
+        bool ValueEscapes(bool viaCalls, List<VarDecl*> *seen);
+        static bool VarEscapes(VarDecl *v, bool viaCalls,
+                               List<VarDecl*> *seen);
 
     public:
         Expr(yyltype loc);
         Expr(void);
         Type *type(void);
+        // The literal this expression folded to during checking, or
+        // the expression itself. Holders of checked children replace
+        // them with this.
+        Expr *Folded(void);
+
+        // Escape analysis. Could the object this expression evaluates
+        // to outlive the current activation? With viaCalls false, any
+        // use as a receiver or argument also counts, which is what
+        // breaking the object up into scalars requires.
+        bool ValueEscapes(bool viaCalls);
+        // Same question for every object stored in local v
+        static bool VarEscapes(VarDecl *v);
+
+        // Loop optimization marks: computed once before the loop, or
+        // turned into an add of the stride on each iteration
+        bool hoisted(void);
+        void MarkHoisted(void);
+        bool reduced(void);
+        void MarkReduced(void);
 };
 
 /* This node type is used for those places where an expression is op-
@@ -41,6 +71,7 @@ class EmptyExpr : public Expr
 {
     public:
         EmptyExpr(void);
+        int Save(AstWriter *w);
 };
 
 /* Assign type to constant */
@@ -51,6 +82,8 @@ class IntConstant : public Expr
 
     public:
         IntConstant(yyltype loc, int val);
+        int Save(AstWriter *w);
+        int value(void);
 };
 
 class DoubleConstant : public Expr
@@ -60,6 +93,8 @@ class DoubleConstant : public Expr
 
     public:
         DoubleConstant(yyltype loc, double val);
+        int Save(AstWriter *w);
+        double value(void);
 };
 
 class BoolConstant : public Expr
@@ -69,21 +104,26 @@ class BoolConstant : public Expr
 
     public:
         BoolConstant(yyltype loc, bool val);
+        int Save(AstWriter *w);
+        bool value(void);
 };
 
 class StringConstant : public Expr
 {
     protected:
-        char *value_;
+        PooledString *value_; // shared with every identical literal
 
     public:
-        StringConstant(yyltype loc, const char *val);
+        StringConstant(yyltype loc, PooledString *val);
+        int Save(AstWriter *w);
+        PooledString *value(void);
 };
 
 class NullConstant: public Expr
 {
     public:
         NullConstant(yyltype loc);
+        int Save(AstWriter *w);
 };
 
 class Operator : public Node
@@ -93,6 +133,8 @@ class Operator : public Node
 
     public:
         Operator(yyltype loc, const char *lexeme);
+        int Save(AstWriter *w);
+        const char *lexeme(void);
         friend std::ostream& operator<<(std::ostream& out,
                                         Operator *o);
 };
@@ -103,10 +145,18 @@ class CompoundExpr : public Expr
         Operator *op_;
         Expr *left_, *right_;
         void OperandCheck(void);
+        // After a clean check, replace constant operands by a literal
+        void Fold(void);
+        int SaveAs(AstWriter *w, int kind); // records any AstKind
 
     public:
         CompoundExpr(Expr *lhs, Operator *op, Expr *rhs);
         CompoundExpr(Operator *op, Expr *rhs);
+
+        Operator *op(void);
+        Expr *left(void); // NULL for unary operators
+        Expr *right(void);
+        void GetChildren(List<Node*> *children);
 };
 
 class ArithmeticExpr : public CompoundExpr
@@ -121,6 +171,7 @@ class ArithmeticExpr : public CompoundExpr
     public:
         ArithmeticExpr(Expr *lhs, Operator *op, Expr *rhs);
         ArithmeticExpr(Operator *op, Expr *rhs);
+        int Save(AstWriter *w);
 };
 
 class RelationalExpr : public CompoundExpr
@@ -130,6 +181,7 @@ class RelationalExpr : public CompoundExpr
 
     public:
         RelationalExpr(Expr *lhs, Operator *op, Expr *rhs);
+        int Save(AstWriter *w);
 };
 
 class EqualityExpr : public CompoundExpr
@@ -139,6 +191,7 @@ class EqualityExpr : public CompoundExpr
 
     public:
         EqualityExpr(Expr *lhs, Operator *op, Expr *rhs);
+        int Save(AstWriter *w);
 
         const char *GetPrintNameForNode(void);
 };
@@ -155,6 +208,7 @@ class LogicalExpr : public CompoundExpr
     public:
         LogicalExpr(Expr *lhs, Operator *op, Expr *rhs);
         LogicalExpr(Operator *op, Expr *rhs);
+        int Save(AstWriter *w);
 
         const char *GetPrintNameForNode(void);
 };
@@ -162,11 +216,18 @@ class LogicalExpr : public CompoundExpr
 class AssignExpr : public CompoundExpr
 {
     protected:
+        bool write_barrier_; // records a heap-to-heap reference store
         void DoCheck(void);
 
     public:
         AssignExpr(Expr *lhs, Operator *op, Expr *rhs);
+        int Save(AstWriter *w);
         const char *GetPrintNameForNode();
+
+        bool write_barrier(void);
+        // A generational collector must see every reference stored into
+        // a heap object, since the object may be older than the value.
+        void AnalyzeWriteBarrier(void);
 };
 
 class LValue : public Expr
@@ -182,16 +243,25 @@ class This : public Expr
 
     public:
         This(yyltype loc) : Expr(loc) {}
+        int Save(AstWriter *w);
 };
 
 class ArrayAccess : public LValue
 {
     protected:
         Expr *base_, *subscript_;
+        bool bounds_check_; // cleared when the index is proven in range
         void DoCheck(void);
 
     public:
         ArrayAccess(yyltype loc, Expr *base, Expr *subscript);
+        int Save(AstWriter *w);
+
+        Expr *base(void);
+        Expr *subscript(void);
+        bool bounds_check(void);
+        void RemoveBoundsCheck(void);
+        void GetChildren(List<Node*> *children);
 };
 
 /* Note that field access is used both for qualified names
@@ -210,10 +280,16 @@ class FieldAccess : public LValue
     protected:
         Expr *base; // will be NULL if no explicit base
         Identifier *field;
+        VarDecl *var_; // the variable or field it resolved to
         void DoCheck(void);
 
     public:
         FieldAccess(Expr *base, Identifier *field); //NULL base is OK
+        int Save(AstWriter *w);
+
+        Expr *GetBase(void);
+        VarDecl *var(void);
+        void GetChildren(List<Node*> *children);
 };
 
 /* Like field access, call is used both for qualified base.field()
@@ -226,26 +302,75 @@ class Call : public Expr
         void UnaryCheck(void);
         void BinaryCheck(void);
         void CallCheck(FnDecl *f);
+        void SetDispatch(dispatchT kind, Decl *receiver);
 
     protected:
         Expr *base; // will be NULL if no explicit base
         Identifier *field;
         List<Expr*> *actuals;
+        FnDecl *target_;       // statically resolved callee
+        dispatchT dispatch_;
+        Decl *receiver_;       // static receiver class or interface
+        List<FnDecl*> *candidates_; // possible targets, by hierarchy
+        bool inlined_;
+        long profile_count_;   // calls made here in the profile, or -1
+        FnDecl *guarded_target_; // the profile's dominant target
         void DoCheck(void);
 
     public:
+        // An inline cache wider than this would not pay for itself
+        static const int maxPolymorphic = 4;
+
         Call(yyltype loc, Expr *base, Identifier *field,
              List<Expr*> *args);
+        int Save(AstWriter *w);
+
+        Expr *GetBase(void);
+        List<Expr*> *GetActuals(void);
+        FnDecl *target(void);
+        dispatchT dispatch(void);
+        List<FnDecl*> *candidates(void);
+        void GetChildren(List<Node*> *children);
+
+        // Collect every method this dynamic call may reach among the
+        // given classes. Needs slots, so runs after class layout.
+        void Classify(List<ClassDecl*> *classes);
+        // The method a receiver of class c would run, NULL if c is not
+        // a possible receiver
+        FnDecl *TargetIn(ClassDecl *c);
+        // The callee if the call has exactly one possible target
+        FnDecl *DevirtualizedTarget(void);
+        // Set by the inliner when the callee body replaces the call
+        bool inlined(void);
+        void MarkInlined(void);
+
+        // From a loaded profile. A guarded target is called directly,
+        // or inlined, behind a check of the receiver's class.
+        long profile_count(void);
+        void set_profile_count(long n);
+        FnDecl *guarded_target(void);
+        void SetGuardedTarget(FnDecl *f);
+
+        // Whether some possible callee lets its receiver or its n-th
+        // argument escape
+        bool ReceiverEscapes(void);
+        bool ActualEscapes(int n);
 };
 
 class NewExpr : public Expr
 {
     protected:
         NamedType *cType;
+        allocT alloc_;
         void DoCheck(void);
 
     public:
         NewExpr(yyltype loc, NamedType *clsType);
+        int Save(AstWriter *w);
+
+        allocT allocation(void);
+        // Pick stack or scalar storage when the object cannot escape
+        void AnalyzeEscape(void);
 };
 
 class NewArrayExpr : public Expr
@@ -253,22 +378,33 @@ class NewArrayExpr : public Expr
     protected:
         Expr *size;
         Type *elemType;
+        allocT alloc_;
         void DoCheck(void);
 
     public:
+        // Larger constant-size arrays stay on the heap
+        static const int maxStackElems = 16;
+
         NewArrayExpr(yyltype loc, Expr *sizeExpr, Type *elemType);
+        int Save(AstWriter *w);
+
+        void GetChildren(List<Node*> *children);
+        allocT allocation(void);
+        void AnalyzeEscape(void);
 };
 
 class ReadIntegerExpr : public Expr
 {
     public:
         ReadIntegerExpr(yyltype loc);
+        int Save(AstWriter *w);
 };
 
 class ReadLineExpr : public Expr
 {
     public:
         ReadLineExpr(yyltype loc);
+        int Save(AstWriter *w);
 };
 
 #endif
@@ -7,190 +7,1741 @@
 #include "ast_type.h"
 #include "ast_decl.h"
 #include "ast_expr.h"
+#include "astcache.h"
 #include "errors.h"
+#include "profile.h"
+#include "stats.h"
+#include "trace.h"
+#include "xref.h"
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
 
 Program::Program(List<Decl*> *dec)
 {
     Assert(dec != NULL);
     (decls_ = dec)->set_parent_all(this);
     sym_table_ = new Hashtable<Decl*>();
+    call_sites_ = new List<Call*>;
+    imports_ = new List<Decl*>;
+    import_files_ = new List<const char*>;
+}
+
+int Program::Save(AstWriter *w)
+{
+    int decls = w->SaveList(decls_);
+    int r = w->Begin(AstProgram, NULL);
+    w->Put(decls);
+
+    return r;
+}
+
+void Program::Import(Program *library, const char *file)
+{
+    file = strdup(file);
+    for (Decl *d : *library->decls_) {
+        d->set_parent(this);
+        imports_->Append(d);
+        import_files_->Append(file);
+    }
+
+    return;
+}
+
+// The interface file an imported declaration came from, NULL for the
+// program's own
+const char *Program::ImportedFrom(Decl *d)
+{
+    for (int i = 0; i < imports_->NumElements(); i++) {
+        if (imports_->Nth(i) == d) {
+            return import_files_->Nth(i);
+        }
+    }
+
+    return NULL;
 }
 
 void Program::DoCheck(void)
 {
-    // (1) Conflicting declaration check
-    for (int i = 0; i < decls_->NumElements(); i++) {
-        Decl *newdecl = decls_->Nth(i);
-        char *name = newdecl->id()->name();
-        Decl *olddecl = sym_table_->Lookup(name);
-        if (olddecl == NULL) {
-            sym_table_->Enter(name, newdecl);
-        } else {
-            ReportError::DeclConflict(newdecl, olddecl);
-        }
+    // (1) Conflicting declaration check, imports first
+    for (int i = 0; i < imports_->NumElements() + decls_->NumElements();
+         i++) {
+        Decl *newdecl = i < imports_->NumElements() ? imports_->Nth(i) :
+                        decls_->Nth(i - imports_->NumElements());
+        char *name = newdecl->id()->name();
+        Decl *olddecl = sym_table_->Lookup(name);
+        if (olddecl == NULL) {
+            sym_table_->Enter(name, newdecl);
+        } else if (ImportedFrom(olddecl) != NULL) {
+            ReportError::ImportConflict(newdecl, ImportedFrom(newdecl),
+                                        ImportedFrom(olddecl));
+        } else {
+            ReportError::DeclConflict(newdecl, olddecl);
+        }
+    }
+
+    // Imported declarations have no bodies, so checking them only
+    // resolves their types and builds their scopes. Their uses belong
+    // in the cross-reference index of their own program.
+    if (imports_->NumElements() > 0) {
+        TraceSpan span(TraceCheck, "Imports");
+        bool indexing = xrefOn;
+        xrefOn = false;
+        for (Decl *import : *imports_) {
+            import->Check();
+        }
+        xrefOn = indexing;
+    }
+
+    // Check should always follow construction of the symbol table,
+    // otherwise any forward declaration will fail.
+    for (Decl *decl : *decls_) {
+        TraceSpan span(TraceCheck, decl->id()->name());
+        decl->Check();
+        RecordDefinition(decl);
+    }
+
+    return;
+}
+
+void Program::Layout(void)
+{
+    // Interfaces are numbered first, since every class's itable
+    // directory is indexed by interface number.
+    int numInterfaces = 0;
+    for (int i = 0; i < imports_->NumElements() + decls_->NumElements();
+         i++) {
+        Decl *d = i < imports_->NumElements() ? imports_->Nth(i) :
+                  decls_->Nth(i - imports_->NumElements());
+        InterfaceDecl *intf = dynamic_cast<InterfaceDecl*>(d);
+        if (intf != NULL) {
+            intf->Layout(numInterfaces++);
+        }
+    }
+    List<ClassDecl*> classes;
+    GetClasses(&classes);
+    for (ClassDecl *c : classes) {
+        c->Layout();
+    }
+
+    for (Call *site : *call_sites_) {
+        site->Classify(&classes);
+    }
+
+    for (int i = 0; i < NumPooledStrings(); i++) {
+        PooledString *s = NthPooledString(i);
+        PrintDebug("strings", "#%d: length %d, hash %08x, \"%s\"",
+                   s->index, s->length, s->hash, s->chars);
+    }
+
+    return;
+}
+
+// Every class, imported ones first; a call through an imported type
+// may reach any of them
+void Program::GetClasses(List<ClassDecl*> *classes)
+{
+    for (Decl *import : *imports_) {
+        ClassDecl *c = dynamic_cast<ClassDecl*>(import);
+        if (c != NULL) {
+            classes->Append(c);
+        }
+    }
+    for (Decl *decl : *decls_) {
+        ClassDecl *c = dynamic_cast<ClassDecl*>(decl);
+        if (c != NULL) {
+            classes->Append(c);
+        }
+    }
+
+    return;
+}
+
+void Program::GetChildren(List<Node*> *children)
+{
+    for (Decl *decl : *decls_) {
+        children->Append(decl);
+    }
+
+    return;
+}
+
+// Nodes in the tree below n, the inliner's measure of code size
+static int CountNodes(Node *n)
+{
+    List<Node*> children;
+    int count = 1;
+
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        count += CountNodes(child);
+    }
+
+    return count;
+}
+
+static void CollectCalls(Node *n, List<Call*> *calls)
+{
+    List<Node*> children;
+
+    if (dynamic_cast<Call*>(n) != NULL) {
+        calls->Append(dynamic_cast<Call*>(n));
+    }
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        CollectCalls(child, calls);
+    }
+
+    return;
+}
+
+static int LoopDepth(Node *n)
+{
+    int depth = 0;
+
+    for (Node *p = n->parent(); p != NULL; p = p->parent()) {
+        if (dynamic_cast<LoopStmt*>(p) != NULL) {
+            depth++;
+        }
+        if (dynamic_cast<FnDecl*>(p) != NULL) {
+            break;
+        }
+    }
+
+    return depth;
+}
+
+// One possible callee of a call site
+struct CallEdge {
+    Call *call;
+    int callee; // position in the graph's function list
+};
+
+// Call graph over the program's functions, plus Tarjan's state
+struct CallGraph {
+    List<FnDecl*> *fns;
+    std::vector<List<Call*>*> calls;        // made by fns->Nth(i)
+    std::vector<std::vector<CallEdge> > edges;
+    std::vector<int> size;                  // AST nodes in the body
+    std::vector<bool> recursive;            // on a call graph cycle
+    std::map<FnDecl*, int> number;
+    std::vector<int> index, lowlink, component, stack;
+    std::vector<std::vector<int> > members; // of each component
+    std::vector<bool> on_stack;
+    int next_index, num_components;
+};
+
+static void StrongConnect(CallGraph *g, int v)
+{
+    g->index[v] = g->lowlink[v] = g->next_index++;
+    g->stack.push_back(v);
+    g->on_stack[v] = true;
+
+    for (size_t i = 0; i < g->edges[v].size(); i++) {
+        int w = g->edges[v][i].callee;
+        if (g->index[w] < 0) {
+            StrongConnect(g, w);
+            g->lowlink[v] = std::min(g->lowlink[v], g->lowlink[w]);
+        } else if (g->on_stack[w]) {
+            g->lowlink[v] = std::min(g->lowlink[v], g->index[w]);
+        }
+    }
+
+    // Components complete callees first, which is bottom-up order
+    if (g->lowlink[v] == g->index[v]) {
+        int w;
+        g->members.push_back(std::vector<int>());
+        do {
+            w = g->stack.back();
+            g->stack.pop_back();
+            g->on_stack[w] = false;
+            g->component[w] = g->num_components;
+            g->members.back().push_back(w);
+        } while (w != v);
+        g->num_components++;
+    }
+
+    return;
+}
+
+// Every call gets an edge to each function it may reach: its single
+// target when known, otherwise each hierarchy candidate.
+static void BuildCallGraph(List<FnDecl*> *fns, CallGraph *g)
+{
+    int n = fns->NumElements();
+
+    g->fns = fns;
+    g->edges.resize(n);
+    g->size.assign(n, 0);
+    g->recursive.assign(n, false);
+    g->index.assign(n, -1);
+    g->lowlink.assign(n, -1);
+    g->component.assign(n, -1);
+    g->on_stack.assign(n, false);
+    g->next_index = g->num_components = 0;
+    for (int i = 0; i < n; i++) {
+        g->number[fns->Nth(i)] = i;
+    }
+    for (int i = 0; i < n; i++) {
+        FnDecl *f = fns->Nth(i);
+        List<Call*> *calls = new List<Call*>;
+        if (f->body() != NULL) {
+            CollectCalls(f->body(), calls);
+            g->size[i] = CountNodes(f->body());
+        }
+        for (Call *c : *calls) {
+            List<FnDecl*> targets;
+            if (c->DevirtualizedTarget() != NULL) {
+                targets.Append(c->DevirtualizedTarget());
+            } else {
+                targets.AppendAll(*c->candidates());
+            }
+            for (FnDecl *target : targets) {
+                if (g->number.count(target) != 0) {
+                    CallEdge e = {c, g->number[target]};
+                    g->edges[i].push_back(e);
+                }
+            }
+        }
+        g->calls.push_back(calls);
+    }
+    for (int i = 0; i < n; i++) {
+        if (g->index[i] < 0) {
+            StrongConnect(g, i);
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        g->recursive[i] = g->members[g->component[i]].size() > 1;
+        for (size_t j = 0; j < g->edges[i].size(); j++) {
+            if (g->edges[i][j].callee == i) {
+                g->recursive[i] = true;
+            }
+        }
+    }
+
+    return;
+}
+
+/* Statically estimate how often each function runs per run of main,
+ * in the spirit of a tiered VM's invocation and back-edge counters.
+ * Components are visited callers first. A call inside loops counts
+ * ten times per level of nesting, and every possible target of a
+ * dynamic call is charged the full count. A recursive component is
+ * assumed to go ten levels deep, and since its members call each
+ * other, each of them is charged everything that enters it.
+ */
+void Program::EstimateFrequencies(CallGraph *g)
+{
+    int n = g->fns->NumElements();
+    std::vector<double> freq(n, 0.0);
+
+    for (int i = 0; i < n; i++) {
+        FnDecl *f = g->fns->Nth(i);
+        if (f->parent() == this && strcmp(f->id()->name(), "main") == 0) {
+            freq[i] = 1;
+        }
+    }
+    for (int scc = g->num_components - 1; scc >= 0; scc--) {
+        const std::vector<int> &members = g->members[scc];
+        if (g->recursive[members[0]]) {
+            double entered = 0;
+            for (size_t m = 0; m < members.size(); m++) {
+                entered += freq[members[m]];
+            }
+            for (size_t m = 0; m < members.size(); m++) {
+                freq[members[m]] = entered * 10;
+            }
+        }
+        for (size_t m = 0; m < members.size(); m++) {
+            int i = members[m];
+            for (size_t j = 0; j < g->edges[i].size(); j++) {
+                CallEdge e = g->edges[i][j];
+                if (g->component[e.callee] != scc) {
+                    freq[e.callee] += freq[i] * pow(10, LoopDepth(e.call));
+                }
+            }
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        g->fns->Nth(i)->set_frequency(freq[i]);
+    }
+
+    return;
+}
+
+// Profile sites below n in source order: tests and calls
+static void CollectSites(Node *n, List<Node*> *sites)
+{
+    Call *c = dynamic_cast<Call*>(n);
+    List<Node*> children;
+
+    if (dynamic_cast<ConditionalStmt*>(n) != NULL ||
+        (c != NULL && c->dispatch() != ArrayLengthCall)) {
+        sites->Append(n);
+    }
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        CollectSites(child, sites);
+    }
+
+    return;
+}
+
+/* Use the profile named by --profile-in, if any: measured call counts
+ * replace the static estimates, a loop's average trip count picks
+ * its unroll factor, the rarely taken side of an if is marked cold,
+ * and a dynamic call whose receivers are nearly all of one class
+ * (-fpgo-guard-percent, default 90) gets a guarded direct target.
+ * Every call site gets the number of calls made there for Inline: a
+ * direct call from its own calls record, keyed by site, and a dynamic
+ * call from the total of its receiver counts.
+ * --profile-out writes the static estimates in the same form, as a
+ * list of the keys this program has and a baseline to compare with.
+ */
+void Program::ApplyProfile(CallGraph *g)
+{
+    const char *in = GetStringOption("profile-in");
+    const char *out = GetStringOption("profile-out");
+    const int guardPercent = GetOption("pgo-guard-percent", 90);
+    bool profiled = (in != NULL && ReadProfile(in));
+    List<ClassDecl*> classes;
+
+    if (!profiled && out == NULL) {
+        return;
+    }
+    GetClasses(&classes);
+
+    for (FnDecl *f : *g->fns) {
+        std::string name = f->GetQualifiedName();
+        long count;
+        if (profiled && ProfiledCalls(name.c_str(), &count)) {
+            f->set_frequency(count);
+        }
+        if (out != NULL) {
+            RecordCalls(name.c_str(), (long)f->frequency());
+        }
+        if (f->body() == NULL) {
+            continue;
+        }
+
+        List<Node*> sites;
+        std::map<std::string, int> ordinals;
+        CollectSites(f->body(), &sites);
+        for (Node *n : sites) {
+            ConditionalStmt *cs = dynamic_cast<ConditionalStmt*>(n);
+            Call *c = dynamic_cast<Call*>(n);
+            yyltype *loc = (cs != NULL ? cs->GetTest()->location() :
+                            n->location());
+            if (loc == NULL) {
+                continue;
+            }
+            char site[300];
+            snprintf(site, sizeof(site), "%s+%d", name.c_str(),
+                     loc->first_line - f->location()->first_line);
+            // Direct calls are numbered apart from dynamic ones, so
+            // the keys of profiles written before they had any hold
+            bool direct = (c != NULL && c->dispatch() == StaticCall);
+            std::string key = std::string(cs != NULL ? "b" :
+                                          direct ? "s" : "c") + site;
+            snprintf(site + strlen(site), sizeof(site) - strlen(site),
+                     "#%d", ordinals[key]++);
+            double runs = f->frequency() * pow(10, LoopDepth(n));
+
+            if (cs != NULL) {
+                LoopStmt *loop = dynamic_cast<LoopStmt*>(cs);
+                IfStmt *branch = dynamic_cast<IfStmt*>(cs);
+                long taken, notTaken;
+                if (out != NULL) {
+                    RecordBranch(site, (long)(loop ? runs * 10 : runs / 2),
+                                 (long)(loop ? runs : runs / 2));
+                }
+                if (!profiled || !ProfiledBranch(site, &taken, &notTaken) ||
+                    taken + notTaken == 0) {
+                    continue;
+                }
+                if (loop != NULL) {
+                    long trips = taken / (notTaken > 0 ? notTaken : 1);
+                    int body = CountNodes(loop->GetBody());
+                    loop->set_unroll(trips >= 16 && body <= 16 ? 4 :
+                                     trips >= 4 && body <= 32 ? 2 : 1);
+                    PrintDebug("pgo", "%s: %ld trips per entry, unroll %d",
+                               site, trips, loop->unroll());
+                } else if (taken * 10 <= taken + notTaken) {
+                    branch->GetBody()->MarkCold();
+                    PrintDebug("pgo", "%s: then branch cold (%ld of %ld)",
+                               site, taken, taken + notTaken);
+                } else if (notTaken * 10 <= taken + notTaken &&
+                           branch->GetElse() != NULL) {
+                    branch->GetElse()->MarkCold();
+                    PrintDebug("pgo", "%s: else branch cold (%ld of %ld)",
+                               site, notTaken, taken + notTaken);
+                }
+                continue;
+            }
+
+            if (direct) {
+                long calls;
+                if (out != NULL) {
+                    RecordCalls(site, (long)runs);
+                }
+                if (profiled && ProfiledCalls(site, &calls)) {
+                    c->set_profile_count(calls);
+                }
+                continue;
+            }
+
+            List<ReceiverCount> counts;
+            if (out != NULL) {
+                List<ClassDecl*> receivers;
+                List<ReceiverCount> estimate;
+                for (int k = 0; k < classes.NumElements(); k++) {
+                    if (c->TargetIn(classes.Nth(k)) != NULL) {
+                        receivers.Append(classes.Nth(k));
+                    }
+                }
+                for (int k = 0; k < receivers.NumElements(); k++) {
+                    ReceiverCount rc = {receivers.Nth(k)->id()->name(),
+                                        (long)(runs / receivers.NumElements())};
+                    estimate.Append(rc);
+                }
+                RecordReceivers(site, &estimate);
+            }
+            if (!profiled || !ProfiledReceivers(site, &counts)) {
+                continue;
+            }
+            long total = 0;
+            ReceiverCount top = {NULL, -1};
+            for (int k = 0; k < counts.NumElements(); k++) {
+                total += counts.Nth(k).count;
+                if (counts.Nth(k).count > top.count) {
+                    top = counts.Nth(k);
+                }
+            }
+            c->set_profile_count(total);
+            if (top.className == NULL) {
+                continue; // no receivers recorded, so the call never ran
+            }
+            ClassDecl *cls = dynamic_cast<ClassDecl*>(
+                sym_table_->Lookup(top.className));
+            FnDecl *target = (cls == NULL ? NULL : c->TargetIn(cls));
+            if (target != NULL && c->DevirtualizedTarget() == NULL &&
+                total > 0 && top.count * 100 >= total * guardPercent) {
+                c->SetGuardedTarget(target);
+                PrintDebug("pgo", "%s: guarded call to %s (%ld of %ld)",
+                           site, target->GetQualifiedName(), top.count,
+                           total);
+            }
+        }
+    }
+    if (out != NULL) {
+        WriteProfile(out);
+    }
+
+    return;
+}
+
+// The global functions and class methods among the declarations
+static void CollectFns(List<Decl*> *decls, List<FnDecl*> *fns)
+{
+    for (Decl *d : *decls) {
+        if (dynamic_cast<FnDecl*>(d) != NULL) {
+            fns->Append(dynamic_cast<FnDecl*>(d));
+        } else if (dynamic_cast<ClassDecl*>(d) != NULL) {
+            List<Node*> members;
+            d->GetChildren(&members);
+            for (Node *member : members) {
+                FnDecl *f = dynamic_cast<FnDecl*>(member);
+                if (f != NULL) {
+                    fns->Append(f);
+                }
+            }
+        }
+    }
+
+    return;
+}
+
+void Program::Optimize(void)
+{
+    const int hot = GetOption("hot-threshold", 10);
+    List<FnDecl*> fns;
+    CallGraph g;
+
+    CollectFns(decls_, &fns);
+
+    {
+        TraceSpan span(TraceOptimize, "BuildCallGraph");
+        BuildCallGraph(&fns, &g);
+        EstimateFrequencies(&g);
+        ApplyProfile(&g);
+    }
+    OptimizeFns(&g, hot);
+    {
+        TraceSpan span(TraceOptimize, "Inline");
+        Inline(&g);
+    }
+
+    for (int i = 0; i < fns.NumElements(); i++) {
+        delete g.calls[i];
+    }
+
+    return;
+}
+
+/* The functions still to be optimized, shared by the threads that
+ * optimize them, and the debug output of each function.
+ */
+struct OptimizeTasks {
+    CallGraph *graph;
+    int hot;
+    std::atomic<int> next;
+    std::vector<std::string> output;
+};
+
+static void OptimizeWorker(OptimizeTasks *t)
+{
+    int i;
+
+    while ((i = t->next++) < t->graph->fns->NumElements()) {
+        FnDecl *f = t->graph->fns->Nth(i);
+        struct timespec start, end;
+
+        CaptureDebug(&t->output[i]);
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+        {
+            TraceSpan span(TraceOptimize, f->GetQualifiedName());
+            f->Optimize(t->hot);
+        }
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+        long micros = (end.tv_sec - start.tv_sec) * 1000000L +
+                      (end.tv_nsec - start.tv_nsec) / 1000;
+        PrintDebug("tiers", "%s: ~%g calls, %d nodes, tier %d, "
+                   "optimized in %ld us", f->GetQualifiedName(),
+                   f->frequency(), t->graph->size[i], f->tier(), micros);
+        CaptureDebug(NULL);
+    }
+
+    return;
+}
+
+/* Run FnDecl::Optimize over every function on -fjobs threads (0 for
+ * one per hardware thread). Optimize only changes the function's own
+ * body, so the functions are independent tasks, taken in declaration
+ * order by whichever thread is free. Each function's debug output goes
+ * to its own buffer and the buffers are printed in declaration order,
+ * so the output is the same for any number of jobs. Whatever functions
+ * share is computed before the threads start: the escape summaries,
+ * which callers otherwise fill in on first use, and the qualified
+ * names, for the imported functions as well as the program's own. The
+ * class layout was already done by Program::Layout.
+ */
+void Program::OptimizeFns(CallGraph *g, int hot)
+{
+    int n = g->fns->NumElements();
+    int jobs = GetOption("jobs", 1);
+    OptimizeTasks tasks;
+    std::vector<std::thread> threads;
+    List<FnDecl*> shared;
+
+    if (jobs <= 0) {
+        jobs = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    shared.AppendAll(*g->fns);
+    CollectFns(imports_, &shared);
+    for (FnDecl *f : shared) {
+        f->ThisEscapes();
+        f->GetQualifiedName();
+    }
+
+    tasks.graph = g;
+    tasks.hot = hot;
+    tasks.next = 0;
+    tasks.output.resize(n);
+    for (int i = 1; i < jobs && i < n; i++) {
+        threads.push_back(std::thread(OptimizeWorker, &tasks));
+    }
+    OptimizeWorker(&tasks);
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    for (int i = 0; i < n; i++) {
+        fputs(tasks.output[i].c_str(), stdout);
+    }
+
+    return;
+}
+
+/* Decide which calls to inline. Candidates are calls with a single
+ * possible callee that has a body: direct calls to global functions,
+ * dynamic calls that class hierarchy analysis devirtualized, and
+ * dynamic calls the profile gave a guarded target. Strongly connected
+ * components of the call graph are visited callees first, so a
+ * callee's size already includes whatever was inlined into it.
+ * Functions on a recursive cycle are never inlined anywhere.
+ *
+ * A call is inlined when the callee's size, in AST nodes, is at most
+ * the call's benefit plus -finline-threshold. The benefit is the call
+ * sequence saved (-finline-call-cost, plus one per argument and
+ * receiver), plus two per constant argument that could fold in the
+ * body, all scaled by the loop nesting depth of the call and doubled
+ * if the profile shows the call hot (-fhot-threshold calls). Calls the
+ * profile shows never run are left alone. The profile counts calls at
+ * each site, direct ones included (see ApplyProfile). No caller may
+ * grow beyond -finline-max-size nodes.
+ */
+void Program::Inline(CallGraph *g)
+{
+    const int threshold = GetOption("inline-threshold", 8);
+    const int callCost = GetOption("inline-call-cost", 4);
+    const int maxSize = GetOption("inline-max-size", 400);
+    const int hot = GetOption("hot-threshold", 10);
+    List<FnDecl*> *fns = g->fns;
+    std::vector<int> size(g->size);
+
+    for (int scc = 0; scc < g->num_components; scc++) {
+        for (size_t m = 0; m < g->members[scc].size(); m++) {
+            int i = g->members[scc][m];
+            FnDecl *caller = fns->Nth(i);
+            List<Call*> *calls = g->calls[i];
+            for (Call *c : *calls) {
+                FnDecl *callee = c->DevirtualizedTarget();
+                int line = c->location()->first_line;
+
+                if (callee == NULL) {
+                    callee = c->guarded_target();
+                }
+
+                if (callee == NULL || callee->body() == NULL ||
+                    g->number.count(callee) == 0) {
+                    if (c->dispatch() != ArrayLengthCall &&
+                        c->candidates()->NumElements() > 1) {
+                        PrintDebug("inline", "%s: line %d: not inlined "
+                                   "%s, %d possible targets",
+                                   caller->GetQualifiedName(), line,
+                                   c->target()->GetQualifiedName(),
+                                   c->candidates()->NumElements());
+                    }
+                    continue;
+                }
+                int k = g->number[callee];
+                const char *name = callee->GetQualifiedName();
+
+                if (g->recursive[k]) {
+                    PrintDebug("inline", "%s: line %d: not inlined %s, "
+                               "recursive", caller->GetQualifiedName(),
+                               line, name);
+                    continue;
+                }
+                if (c->profile_count() == 0) {
+                    PrintDebug("inline", "%s: line %d: not inlined %s, "
+                               "never run in the profile",
+                               caller->GetQualifiedName(), line, name);
+                    continue;
+                }
+
+                List<Expr*> *actuals = c->GetActuals();
+                int benefit = callCost + actuals->NumElements();
+                if (c->dispatch() != StaticCall ||
+                    dynamic_cast<ClassDecl*>(callee->parent()) != NULL) {
+                    benefit++; // the receiver
+                }
+                for (Expr *e : *actuals) {
+                    if (dynamic_cast<IntConstant*>(e) != NULL ||
+                        dynamic_cast<DoubleConstant*>(e) != NULL ||
+                        dynamic_cast<BoolConstant*>(e) != NULL) {
+                        benefit += 2;
+                    }
+                }
+                benefit *= 1 + LoopDepth(c);
+                if (c->profile_count() >= hot) {
+                    benefit *= 2;
+                }
+
+                int grown = size[i] + size[k] - 1;
+                if (size[k] > benefit + threshold) {
+                    PrintDebug("inline", "%s: line %d: not inlined %s, "
+                               "size %d exceeds benefit %d + %d",
+                               caller->GetQualifiedName(), line, name,
+                               size[k], benefit, threshold);
+                } else if (grown > maxSize) {
+                    PrintDebug("inline", "%s: line %d: not inlined %s, "
+                               "caller would grow to %d",
+                               caller->GetQualifiedName(), line, name,
+                               grown);
+                } else {
+                    c->MarkInlined();
+                    size[i] = grown;
+                    PrintDebug("inline", "%s: line %d: inlined %s%s "
+                               "(size %d, benefit %d)",
+                               caller->GetQualifiedName(), line, name,
+                               callee == c->guarded_target() ?
+                               " behind a class guard" : "",
+                               size[k], benefit);
+                }
+            }
+        }
+    }
+
+    return;
+}
+
+void Program::AddCallSite(Call *c)
+{
+    call_sites_->Append(c);
+
+    return;
+}
+
+Program *Program::GetProgram(void)
+{
+    return this;
+}
+
+Decl *Program::GetTypeDecl(NamedType *t)
+{
+    return sym_table_->Lookup(t->id()->name());
+}
+
+FnDecl *Program::GetFn(Identifier *id)
+{
+    Decl *dec = sym_table_->Lookup(id->name());
+    FnDecl *olddecl = dynamic_cast<FnDecl*>(dec);
+    Count(FnHops);
+    Count(LookupCasts);
+
+    return olddecl;
+}
+
+VarDecl *Program::GetVar(Identifier *id)
+{
+    Decl *dec = sym_table_->Lookup(id->name());
+    VarDecl *olddecl = dynamic_cast<VarDecl*>(dec);
+    Count(VarHops);
+    Count(LookupCasts);
+
+    return olddecl;
+}
+
+Stmt::Stmt(void) : Node()
+{
+    dead_ = cold_ = false;
+
+    return;
+}
+
+Stmt::Stmt(yyltype loc) : Node(loc)
+{
+    dead_ = cold_ = false;
+
+    return;
+}
+
+bool Stmt::dead(void)
+{
+    return dead_;
+}
+
+void Stmt::MarkDead(void)
+{
+    dead_ = true;
+
+    return;
+}
+
+bool Stmt::cold(void)
+{
+    return cold_;
+}
+
+void Stmt::MarkCold(void)
+{
+    cold_ = true;
+
+    return;
+}
+
+int Stmt::EliminateBoundsChecks(void)
+{
+    List<Node*> children;
+    int removed = 0;
+
+    GetChildren(&children);
+    for (Node *child : children) {
+        Stmt *s = dynamic_cast<Stmt*>(child);
+        if (s != NULL) {
+            removed += s->EliminateBoundsChecks();
+        }
+    }
+
+    return removed;
+}
+
+Stmt *Stmt::GetContextStmt(void)
+{
+    Stmt *cnt = this;
+    if (dynamic_cast<Stmt*>(parent()) != NULL) {
+        cnt = dynamic_cast<Stmt*>(parent())->GetContextStmt();
+    }
+
+    return cnt;
+}
+
+StmtBlock::StmtBlock(List<VarDecl*> *d, List<Stmt*> *s)
+{
+    Assert(d != NULL && s != NULL);
+    (decls=d)->set_parent_all(this);
+    (stmts=s)->set_parent_all(this);
+    sym_ = new Hashtable<Decl*>();
+
+    return;
+}
+
+int StmtBlock::Save(AstWriter *w)
+{
+    int d = w->SaveList(decls);
+    int s = w->SaveList(stmts);
+    int r = w->Begin(AstStmtBlock, NULL);
+    w->Put(d);
+    w->Put(s);
+
+    return r;
+}
+
+void StmtBlock::DoCheck(void)
+{
+    // (1) Conflicting declaration check
+    for (Decl *newdecl : *decls) {
+        char *name = newdecl->id()->name();
+        Decl *olddecl = sym_->Lookup(name);
+        if (olddecl == NULL) {
+            sym_->Enter(name, newdecl);
+        } else {
+            ReportError::DeclConflict(newdecl, olddecl);
+        }
+    }
+
+    // Check should always follow construction of the symbol table,
+    // otherwise any forward declaration will fail.
+    for (VarDecl *decl : *decls) {
+        decl->Check();
+    }
+
+    for (Stmt *stmt : *stmts) {
+        stmt->Check();
+    }
+
+    return;
+}
+
+void StmtBlock::GetChildren(List<Node*> *children)
+{
+    for (VarDecl *decl : *decls) {
+        children->Append(decl);
+    }
+    for (Stmt *stmt : *stmts) {
+        children->Append(stmt);
+    }
+
+    return;
+}
+
+VarDecl *StmtBlock::GetVar(Identifier *i)
+{
+    Decl *decl = sym_->Lookup(i->name());
+    VarDecl *olddecl = dynamic_cast<VarDecl*>(decl);
+    Count(VarHops);
+    Count(LookupCasts);
+    if (olddecl != NULL) {
+        olddecl->Check();
+    } else {
+        olddecl = parent()->GetVar(i);
+    }
+
+    return olddecl;
+}
+
+
+ConditionalStmt::ConditionalStmt(Expr *t, Stmt *b)
+{
+    Assert(t != NULL && b != NULL);
+    (test=t)->set_parent(this);
+    (body=b)->set_parent(this);
+}
+
+void ConditionalStmt::DoCheck(void)
+{
+    test->Check();
+    test = test->Folded();
+    body->Check();
+
+    // A loop body or then-branch behind a constant false test
+    BoolConstant *known = dynamic_cast<BoolConstant*>(test);
+    if (known != NULL && !known->value()) {
+        body->MarkDead();
+    }
+
+    // testExpr must be boolean type
+    if (test->type() != Type::boolType &&
+        test->type() != Type::errorType) {
+        ReportError::TestNotBoolean(test);
+    }
+
+    return;
+}
+
+Expr *ConditionalStmt::GetTest(void)
+{
+    return test;
+}
+
+Stmt *ConditionalStmt::GetBody(void)
+{
+    return body;
+}
+
+void ConditionalStmt::GetChildren(List<Node*> *children)
+{
+    children->Append(test);
+    if (!body->dead()) {
+        children->Append(body);
+    }
+
+    return;
+}
+
+LoopStmt::LoopStmt(Expr *testExpr, Stmt *body) :
+    ConditionalStmt(testExpr, body)
+{
+    unroll_ = 1;
+
+    return;
+}
+
+int LoopStmt::unroll(void)
+{
+    return unroll_;
+}
+
+void LoopStmt::set_unroll(int n)
+{
+    unroll_ = n;
+
+    return;
+}
+
+Stmt *LoopStmt::GetContextStmt(void)
+{
+    return this;
+}
+
+void LoopStmt::GetIteratedParts(List<Node*> *parts)
+{
+    parts->Append(test);
+    if (!body->dead()) {
+        parts->Append(body);
+    }
+
+    return;
+}
+
+ForStmt::ForStmt(Expr *i, Expr *t, Expr *s, Stmt *b): LoopStmt(t, b)
+{
+    Assert(i != NULL && t != NULL && s != NULL && b != NULL);
+    (init=i)->set_parent(this);
+    (step=s)->set_parent(this);
+    lanes_ = 0;
+}
+
+int ForStmt::Save(AstWriter *w)
+{
+    int i = w->Save(init);
+    int t = w->Save(test);
+    int s = w->Save(step);
+    int b = w->Save(body);
+    int r = w->Begin(AstForStmt, NULL);
+    w->Put(i);
+    w->Put(t);
+    w->Put(s);
+    w->Put(b);
+
+    return r;
+}
+
+void ForStmt::DoCheck(void)
+{
+    init->Check();
+    test->Check();
+    step->Check();
+    body->Check();
+    ConditionalStmt::DoCheck(); // check non-boolean test expr
+
+    return;
+}
+
+void ForStmt::GetChildren(List<Node*> *children)
+{
+    children->Append(init);
+    children->Append(test);
+    children->Append(step);
+    if (!body->dead()) {
+        children->Append(body);
+    }
+
+    return;
+}
+
+// The variable a bare or this-qualified name refers to, NULL otherwise
+static VarDecl *NamedVar(Expr *e)
+{
+    FieldAccess *fa = dynamic_cast<FieldAccess*>(e);
+    if (fa == NULL || (fa->GetBase() != NULL &&
+                       dynamic_cast<This*>(fa->GetBase()) == NULL)) {
+        return NULL;
     }
 
-    // Check should always follow construction of the symbol table,
-    // otherwise any forward declaration will fail.
-    for (int i = 0; i < decls_->NumElements(); i++) {
-        decls_->Nth(i)->Check();
+    return fa->var();
+}
+
+static bool IsIntConstant(Expr *e, int min)
+{
+    IntConstant *c = dynamic_cast<IntConstant*>(e);
+
+    return c != NULL && c->value() >= min;
+}
+
+static bool IsIntValue(Expr *e, int value)
+{
+    IntConstant *c = dynamic_cast<IntConstant*>(e);
+
+    return c != NULL && c->value() == value;
+}
+
+static bool AssignsTo(Node *n, VarDecl *v)
+{
+    AssignExpr *a = dynamic_cast<AssignExpr*>(n);
+    if (a != NULL && NamedVar(a->left()) == v) {
+        return true;
     }
 
-    return;
+    List<Node*> children;
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        if (AssignsTo(child, v)) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
-ClassDecl *Program::GetClass(NamedType *t)
+// Whether n assigns a field of that name through any base, o.a as
+// well as a and this.a; another object of the class may be this one
+static bool AssignsField(Node *n, VarDecl *field)
 {
-    Decl *dec = sym_table_->Lookup(t->id()->name());
-    ClassDecl *olddecl = dynamic_cast<ClassDecl*>(dec);
+    AssignExpr *a = dynamic_cast<AssignExpr*>(n);
+    FieldAccess *fa = a == NULL ? NULL : dynamic_cast<FieldAccess*>(a->left());
+    if (fa != NULL && (fa->var() == NULL ||
+                       strcmp(fa->var()->id()->name(),
+                              field->id()->name()) == 0)) {
+        return true;
+    }
 
-    return olddecl;
+    List<Node*> children;
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        if (AssignsField(child, field)) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
-FnDecl *Program::GetFn(Identifier *id)
+static bool ContainsCall(Node *n)
 {
-    Decl *dec = sym_table_->Lookup(id->name());
-    FnDecl *olddecl = dynamic_cast<FnDecl*>(dec);
+    if (dynamic_cast<Call*>(n) != NULL &&
+        dynamic_cast<Call*>(n)->dispatch() != ArrayLengthCall) {
+        return true;
+    }
 
-    return olddecl;
+    List<Node*> children;
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        if (ContainsCall(child)) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
-VarDecl *Program::GetVar(Identifier *id)
+static int RemoveChecks(Node *n, VarDecl *array, VarDecl *index)
 {
-    Decl *dec = sym_table_->Lookup(id->name());
-    VarDecl *olddecl = dynamic_cast<VarDecl*>(dec);
+    int removed = 0;
+    ArrayAccess *aa = dynamic_cast<ArrayAccess*>(n);
+    if (aa != NULL && aa->bounds_check() &&
+        NamedVar(aa->base()) == array && NamedVar(aa->subscript()) == index) {
+        aa->RemoveBoundsCheck();
+        removed++;
+    }
 
-    return olddecl;
+    List<Node*> children;
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        removed += RemoveChecks(child, array, index);
+    }
+
+    return removed;
 }
 
-InterfaceDecl *Program::GetInterface(NamedType *t)
+int ForStmt::EliminateBoundsChecks(void)
 {
-    char *str = t->id()->name();
-    Decl *dec = sym_table_->Lookup(str);
-    InterfaceDecl *olddecl = dynamic_cast<InterfaceDecl*>(dec);
+    // Recognize for (i = c; i < a.length(); i = i + 1) with c >= 0.
+    // The test runs before every iteration, so 0 <= i < length holds
+    // throughout the body unless the body changes i or a. A larger
+    // step could carry i past the largest int and back below zero.
+    AssignExpr *in = dynamic_cast<AssignExpr*>(init);
+    RelationalExpr *cmp = dynamic_cast<RelationalExpr*>(test);
+    AssignExpr *st = dynamic_cast<AssignExpr*>(step);
+    ArithmeticExpr *inc = st == NULL ? NULL :
+                          dynamic_cast<ArithmeticExpr*>(st->right());
+    Call *len = cmp == NULL ? NULL : dynamic_cast<Call*>(cmp->right());
+    VarDecl *index = in == NULL ? NULL : NamedVar(in->left());
+    VarDecl *array = len == NULL ? NULL : NamedVar(len->GetBase());
+    int removed = 0;
 
-    return olddecl;
+    bool match = (index != NULL && array != NULL && index->IsLocal() &&
+                  IsIntConstant(in->right(), 0) &&
+                  strcmp(cmp->op()->lexeme(), "<") == 0 &&
+                  NamedVar(cmp->left()) == index &&
+                  len->dispatch() == ArrayLengthCall &&
+                  NamedVar(st->left()) == index &&
+                  inc != NULL && inc->left() != NULL &&
+                  strcmp(inc->op()->lexeme(), "+") == 0 &&
+                  NamedVar(inc->left()) == index &&
+                  IsIntValue(inc->right(), 1));
+    match = match && !AssignsTo(body, index) && !AssignsTo(body, array);
+    match = match && (array->IsLocal() || !AssignsField(body, array));
+    // A field or global array may be replaced by any method we call
+    match = match && (array->IsLocal() || !ContainsCall(body));
+    if (match) {
+        removed = RemoveChecks(body, array, index);
+    }
+
+    return removed + Stmt::EliminateBoundsChecks();
 }
 
-Stmt::Stmt(void) : Node()
+void ForStmt::GetIteratedParts(List<Node*> *parts)
 {
+    parts->Append(test);
+    parts->Append(step);
+    if (!body->dead()) {
+        parts->Append(body);
+    }
+
     return;
 }
 
-Stmt::Stmt(yyltype loc) : Node(loc)
+// What one iteration of a loop may change
+struct LoopEffects {
+    List<VarDecl*> vars;        // assigned in the loop
+    List<VarDecl*> declared;    // locals of blocks inside the loop
+    List<Type*> elements;       // types of array elements stored
+    List<AssignExpr*> assigns;
+    bool calls, exits;
+};
+
+static void CollectEffects(Node *n, LoopEffects *fx)
 {
+    AssignExpr *a = dynamic_cast<AssignExpr*>(n);
+    Call *c = dynamic_cast<Call*>(n);
+
+    if (dynamic_cast<VarDecl*>(n) != NULL) {
+        fx->declared.Append(dynamic_cast<VarDecl*>(n));
+    } else if (a != NULL) {
+        FieldAccess *fa = dynamic_cast<FieldAccess*>(a->left());
+        ArrayAccess *aa = dynamic_cast<ArrayAccess*>(a->left());
+        if (fa != NULL) {
+            fx->vars.Append(fa->var());
+        } else if (aa != NULL) {
+            fx->elements.Append(aa->type());
+        }
+        fx->assigns.Append(a);
+    } else if (c != NULL && c->dispatch() != ArrayLengthCall) {
+        fx->calls = true;
+    } else if (dynamic_cast<BreakStmt*>(n) != NULL ||
+               dynamic_cast<ReturnStmt*>(n) != NULL) {
+        fx->exits = true;
+    }
+
+    List<Node*> children;
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        CollectEffects(child, fx);
+    }
+
     return;
 }
 
-Stmt *Stmt::GetContextStmt(void)
+static bool Changes(LoopEffects *fx, VarDecl *v)
 {
-    Stmt *cnt = this;
-    if (dynamic_cast<Stmt*>(parent()) != NULL) {
-        cnt = dynamic_cast<Stmt*>(parent())->GetContextStmt();
+    for (VarDecl *changed : fx->vars) {
+        if (changed == v) {
+            return true;
+        }
+    }
+    for (VarDecl *decl : fx->declared) {
+        if (decl == v) {
+            return true;
+        }
     }
 
-    return cnt;
+    return false;
 }
 
-StmtBlock::StmtBlock(List<VarDecl*> *d, List<Stmt*> *s)
+// Array stores only alias loads of elements of an equivalent type
+static bool StoresElement(LoopEffects *fx, Type *t)
 {
-    Assert(d != NULL && s != NULL);
-    (decls=d)->set_parent_all(this);
-    (stmts=s)->set_parent_all(this);
-    sym_ = new Hashtable<Decl*>();
+    for (Type *elem : fx->elements) {
+        if (elem->IsEquivalentTo(t)) {
+            return true;
+        }
+    }
 
-    return;
+    return false;
 }
 
-void StmtBlock::DoCheck(void)
+static bool IsInvariant(Expr *e, LoopEffects *fx)
 {
-    // (1) Conflicting declaration check
-    for (int i = 0; i < decls->NumElements(); i++) {
-        Decl *newdecl = decls->Nth(i);
-        char *name = newdecl->id()->name();
-        Decl *olddecl = sym_->Lookup(name);
-        if (olddecl == NULL) {
-            sym_->Enter(name, newdecl);
-        } else {
-            ReportError::DeclConflict(newdecl, olddecl);
+    FieldAccess *fa = dynamic_cast<FieldAccess*>(e);
+    ArrayAccess *aa = dynamic_cast<ArrayAccess*>(e);
+    Call *c = dynamic_cast<Call*>(e);
+    CompoundExpr *ce = dynamic_cast<CompoundExpr*>(e);
+
+    if (dynamic_cast<IntConstant*>(e) != NULL ||
+        dynamic_cast<DoubleConstant*>(e) != NULL ||
+        dynamic_cast<BoolConstant*>(e) != NULL ||
+        dynamic_cast<StringConstant*>(e) != NULL ||
+        dynamic_cast<NullConstant*>(e) != NULL ||
+        dynamic_cast<This*>(e) != NULL) {
+        return true;
+    }
+    if (fa != NULL) {
+        VarDecl *v = fa->var();
+        if (v == NULL || Changes(fx, v)) {
+            return false;
+        }
+        if (fa->GetBase() != NULL) {
+            return !fx->calls && IsInvariant(fa->GetBase(), fx);
         }
+        // Fields and globals may be written by any callee
+        return v->IsLocal() || !fx->calls;
+    }
+    if (aa != NULL) {
+        return !fx->calls && !StoresElement(fx, aa->type()) &&
+               IsInvariant(aa->base(), fx) &&
+               IsInvariant(aa->subscript(), fx);
+    }
+    if (c != NULL) {
+        // Arrays never change length
+        return c->dispatch() == ArrayLengthCall &&
+               IsInvariant(c->GetBase(), fx);
+    }
+    if (ce != NULL && dynamic_cast<AssignExpr*>(e) == NULL) {
+        // Division might trap, so it is not moved
+        if (dynamic_cast<ArithmeticExpr*>(e) != NULL &&
+            (strcmp(ce->op()->lexeme(), "/") == 0 ||
+             strcmp(ce->op()->lexeme(), "%") == 0)) {
+            return false;
+        }
+        return (ce->left() == NULL || IsInvariant(ce->left(), fx)) &&
+               IsInvariant(ce->right(), fx);
     }
 
-    // Check should always follow construction of the symbol table,
-    // otherwise any forward declaration will fail.
-    for (int i = 0; i < decls->NumElements(); i++) {
-        decls->Nth(i)->Check();
+    return false;
+}
+
+// Constants and locals are already as cheap as a hoisted temporary
+static bool WorthHoisting(Expr *e)
+{
+    FieldAccess *fa = dynamic_cast<FieldAccess*>(e);
+
+    if (fa != NULL && fa->GetBase() == NULL) {
+        return !fa->var()->IsLocal();
     }
+    return dynamic_cast<IntConstant*>(e) == NULL &&
+           dynamic_cast<DoubleConstant*>(e) == NULL &&
+           dynamic_cast<BoolConstant*>(e) == NULL &&
+           dynamic_cast<StringConstant*>(e) == NULL &&
+           dynamic_cast<NullConstant*>(e) == NULL &&
+           dynamic_cast<This*>(e) == NULL;
+}
+
+// Could evaluating e fail at run time (null object, index range)?
+static bool MayTrap(Node *n)
+{
+    FieldAccess *fa = dynamic_cast<FieldAccess*>(n);
+    Call *c = dynamic_cast<Call*>(n);
 
-    for (int i = 0; i < stmts->NumElements(); i++) {
-        stmts->Nth(i)->Check();
+    if (dynamic_cast<ArrayAccess*>(n) != NULL || c != NULL ||
+        (fa != NULL && fa->GetBase() != NULL &&
+         dynamic_cast<This*>(fa->GetBase()) == NULL)) {
+        return true;
     }
 
-    return;
+    List<Node*> children;
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        if (MayTrap(child)) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
-VarDecl *StmtBlock::GetVar(Identifier *i)
+// Is n evaluated on every iteration that reaches the end of loop?
+static bool AlwaysEvaluated(Node *n, LoopStmt *loop)
 {
-    Decl *decl = sym_->Lookup(i->name());
-    VarDecl *olddecl = dynamic_cast<VarDecl*>(decl);
-    if (olddecl != NULL) {
-        olddecl->Check();
-    } else {
-        olddecl = parent()->GetVar(i);
+    for (Node *p = n->parent(); p != loop; n = p, p = p->parent()) {
+        LogicalExpr *le = dynamic_cast<LogicalExpr*>(p);
+        if (dynamic_cast<ConditionalStmt*>(p) != NULL ||
+            (le != NULL && le->left() != NULL && le->right() == n)) {
+            return false;
+        }
     }
 
-    return olddecl;
+    return true;
 }
 
+static int MarkInvariants(Node *n, LoopStmt *loop, LoopEffects *fx)
+{
+    Expr *e = dynamic_cast<Expr*>(n);
 
-ConditionalStmt::ConditionalStmt(Expr *t, Stmt *b)
+    // Trapping code is only moved when it would have run anyway; the
+    // preheader is entered only if the loop runs at least once.
+    if (e != NULL && IsInvariant(e, fx) && WorthHoisting(e) &&
+        (!MayTrap(e) || (!fx->exits && AlwaysEvaluated(e, loop)))) {
+        e->MarkHoisted();
+        return 1;
+    }
+
+    int count = 0;
+    List<Node*> children;
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        count += MarkInvariants(child, loop, fx);
+    }
+
+    return count;
+}
+
+// A basic induction variable: a local whose one update in the loop is
+// v = v + c or v = v - c with c invariant
+static bool IsInductionVar(VarDecl *v, LoopEffects *fx)
 {
-    Assert(t != NULL && b != NULL);
-    (test=t)->set_parent(this);
-    (body=b)->set_parent(this);
+    int updates = 0;
+    bool simple = false;
+
+    if (v == NULL || !v->IsLocal()) {
+        return false;
+    }
+    for (VarDecl *decl : fx->declared) {
+        if (decl == v) {
+            return false;
+        }
+    }
+    for (AssignExpr *a : fx->assigns) {
+        if (NamedVar(a->left()) != v) {
+            continue;
+        }
+        ArithmeticExpr *inc = dynamic_cast<ArithmeticExpr*>(a->right());
+        updates++;
+        simple = (inc != NULL && inc->left() != NULL &&
+                  (strcmp(inc->op()->lexeme(), "+") == 0 ||
+                   strcmp(inc->op()->lexeme(), "-") == 0) &&
+                  NamedVar(inc->left()) == v &&
+                  IsInvariant(inc->right(), fx));
+    }
+
+    return updates == 1 && simple;
 }
 
-void ConditionalStmt::DoCheck(void)
+// Is e an induction variable scaled and offset by invariants?
+static bool IsAffine(Expr *e, LoopEffects *fx)
 {
-    test->Check();
-    body->Check();
+    ArithmeticExpr *ae = dynamic_cast<ArithmeticExpr*>(e);
 
-    // testExpr must be boolean type
-    if (test->type() != Type::boolType &&
-        test->type() != Type::errorType) {
-        ReportError::TestNotBoolean(test);
+    if (IsInductionVar(NamedVar(e), fx)) {
+        return true;
+    }
+    if (ae == NULL || ae->left() == NULL) {
+        return false;
+    }
+    const char *op = ae->op()->lexeme();
+    if (strcmp(op, "+") == 0 || strcmp(op, "-") == 0) {
+        return (IsAffine(ae->left(), fx) &&
+                (IsInvariant(ae->right(), fx) || IsAffine(ae->right(), fx))) ||
+               (IsInvariant(ae->left(), fx) && IsAffine(ae->right(), fx));
+    }
+    if (strcmp(op, "*") == 0) {
+        return (IsAffine(ae->left(), fx) && IsInvariant(ae->right(), fx)) ||
+               (IsInvariant(ae->left(), fx) && IsAffine(ae->right(), fx));
     }
 
-    return;
+    return false;
 }
 
-LoopStmt::LoopStmt(Expr *testExpr, Stmt *body) :
-    ConditionalStmt(testExpr, body)
+static int MarkReductions(Node *n, LoopEffects *fx)
+{
+    ArithmeticExpr *ae = dynamic_cast<ArithmeticExpr*>(n);
+    ArrayAccess *aa = dynamic_cast<ArrayAccess*>(n);
+    int count = 0;
+
+    // i * k becomes a temporary bumped by c * k; the address of a[f(i)]
+    // becomes a pointer bumped by the element stride
+    if (ae != NULL && ae->left() != NULL &&
+        strcmp(ae->op()->lexeme(), "*") == 0 && IsAffine(ae, fx)) {
+        ae->MarkReduced();
+        count++;
+    } else if (aa != NULL && IsInvariant(aa->base(), fx) &&
+               IsAffine(aa->subscript(), fx)) {
+        aa->MarkReduced();
+        count++;
+    }
+
+    List<Node*> children;
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        count += MarkReductions(child, fx);
+    }
+
+    return count;
+}
+
+void LoopStmt::HoistInvariants(int *hoisted, int *reduced)
 {
+    List<Node*> parts;
+    LoopEffects fx;
+
+    fx.calls = fx.exits = false;
+    GetIteratedParts(&parts);
+    for (Node *part : parts) {
+        CollectEffects(part, &fx);
+    }
+
+    *hoisted = *reduced = 0;
+    for (Node *part : parts) {
+        *hoisted += MarkInvariants(part, this, &fx);
+        *reduced += MarkReductions(part, &fx);
+    }
+
     return;
 }
 
-Stmt *LoopStmt::GetContextStmt(void)
+// Scratch state while deciding whether one loop vectorizes
+struct VectorLoop {
+    LoopEffects fx;
+    VarDecl *index;
+    Type *elem;       // the element type of every array access
+    const char *reason;
+};
+
+static int CountReads(Node *n, VarDecl *v)
 {
-    return this;
+    FieldAccess *fa = dynamic_cast<FieldAccess*>(n);
+    int reads = (fa != NULL && fa->var() == v);
+
+    List<Node*> children;
+    n->GetChildren(&children);
+    for (Node *child : children) {
+        reads += CountReads(child, v);
+    }
+
+    return reads;
 }
 
-ForStmt::ForStmt(Expr *i, Expr *t, Expr *s, Stmt *b): LoopStmt(t, b)
+// a[i] with the loop index as subscript loads or stores one lane each
+static bool IsVectorElement(ArrayAccess *aa, VectorLoop *vl)
 {
-    Assert(i != NULL && t != NULL && s != NULL && b != NULL);
-    (init=i)->set_parent(this);
-    (step=s)->set_parent(this);
+    Type *t = aa->type();
+
+    if (t != Type::intType && t != Type::doubleType) {
+        vl->reason = "element type is not int or double";
+    } else if (vl->elem != NULL && vl->elem != t) {
+        vl->reason = "mixes int and double elements";
+    } else if (!IsInvariant(aa->base(), &vl->fx)) {
+        vl->reason = "array base changes in the loop";
+    } else if (NamedVar(aa->subscript()) != vl->index) {
+        vl->reason = "subscript is not the loop index";
+    } else {
+        vl->elem = t;
+        return true;
+    }
+
+    return false;
 }
 
-void ForStmt::DoCheck(void)
+// Can e be computed for several iterations at once? Invariants are
+// broadcast to every lane.
+static bool IsVectorOperand(Expr *e, VectorLoop *vl)
 {
-    init->Check();
-    test->Check();
-    step->Check();
-    body->Check();
-    ConditionalStmt::DoCheck(); // check non-boolean test expr
+    ArrayAccess *aa = dynamic_cast<ArrayAccess*>(e);
+    ArithmeticExpr *ae = dynamic_cast<ArithmeticExpr*>(e);
 
-    return;
+    if (IsInvariant(e, &vl->fx)) {
+        return true;
+    }
+    if (aa != NULL) {
+        return IsVectorElement(aa, vl);
+    }
+    if (ae != NULL) {
+        const char *op = ae->op()->lexeme();
+        if (ae->type() == Type::intType &&
+            (strcmp(op, "/") == 0 || strcmp(op, "%") == 0)) {
+            vl->reason = "integer division has no vector instruction";
+            return false;
+        }
+        if (strcmp(op, "%") == 0) {
+            vl->reason = "double remainder has no vector instruction";
+            return false;
+        }
+        return (ae->left() == NULL || IsVectorOperand(ae->left(), vl)) &&
+               IsVectorOperand(ae->right(), vl);
+    }
+
+    if (NamedVar(e) == vl->index) {
+        vl->reason = "uses the loop index as a value";
+    } else if (dynamic_cast<Call*>(e) != NULL) {
+        vl->reason = "contains a call";
+    } else if (dynamic_cast<CompoundExpr*>(e) != NULL) {
+        vl->reason = "contains a comparison or logical operator";
+    } else if (dynamic_cast<FieldAccess*>(e) != NULL) {
+        vl->reason = "reads a variable written in the loop";
+    } else {
+        vl->reason = "contains an unsupported expression";
+    }
+
+    return false;
+}
+
+/* Vectorizable loops are innermost counted loops, for (i = c; i < n;
+ * i = i + 1) with n invariant, whose body is a list of assignments:
+ * element-wise a[i] = f(b[i], c[i], invariants), or reductions
+ * s = s + f(...) (s = s * f(...) for int) into a local read nowhere
+ * else. With every subscript exactly i there are no dependences
+ * between iterations, whether or not arrays alias, and the bounds
+ * checks reduce to one range check before the loop. Double reductions
+ * change the order of rounding and need -ffast-math=1.
+ */
+const char *ForStmt::Vectorize(void)
+{
+    AssignExpr *in = dynamic_cast<AssignExpr*>(init);
+    RelationalExpr *cmp = dynamic_cast<RelationalExpr*>(test);
+    AssignExpr *st = dynamic_cast<AssignExpr*>(step);
+    ArithmeticExpr *inc = st == NULL ? NULL :
+                          dynamic_cast<ArithmeticExpr*>(st->right());
+    StmtBlock *block = dynamic_cast<StmtBlock*>(body);
+    List<Node*> parts, stmts;
+    VectorLoop vl;
+
+    lanes_ = 0;
+    vl.fx.calls = vl.fx.exits = false;
+    vl.index = in == NULL ? NULL : NamedVar(in->left());
+    vl.elem = NULL;
+    vl.reason = NULL;
+    GetIteratedParts(&parts);
+    for (Node *part : parts) {
+        CollectEffects(part, &vl.fx);
+    }
+
+    if (vl.index == NULL || cmp == NULL ||
+        NamedVar(cmp->left()) != vl.index ||
+        (strcmp(cmp->op()->lexeme(), "<") != 0 &&
+         strcmp(cmp->op()->lexeme(), "<=") != 0) ||
+        !IsInvariant(cmp->right(), &vl.fx) ||
+        !IsInductionVar(vl.index, &vl.fx) || inc == NULL ||
+        strcmp(inc->op()->lexeme(), "+") != 0 ||
+        dynamic_cast<IntConstant*>(inc->right()) == NULL ||
+        dynamic_cast<IntConstant*>(inc->right())->value() != 1) {
+        return "not a counted loop with unit step";
+    }
+
+    if (block != NULL) {
+        block->GetChildren(&stmts);
+    } else {
+        stmts.Append(body);
+    }
+    for (Node *s : stmts) {
+        AssignExpr *a = dynamic_cast<AssignExpr*>(s);
+        if (dynamic_cast<VarDecl*>(s) != NULL) {
+            return "declares locals in the body";
+        } else if (dynamic_cast<LoopStmt*>(s) != NULL) {
+            return "contains a nested loop";
+        } else if (dynamic_cast<PrintStmt*>(s) != NULL) {
+            return "contains I/O";
+        } else if (dynamic_cast<Call*>(s) != NULL) {
+            return "contains a call";
+        } else if (a == NULL) {
+            return "contains control flow";
+        }
+
+        ArrayAccess *dst = dynamic_cast<ArrayAccess*>(a->left());
+        if (dst != NULL) {
+            if (!IsVectorElement(dst, &vl) ||
+                !IsVectorOperand(a->right(), &vl)) {
+                return vl.reason;
+            }
+            continue;
+        }
+
+        VarDecl *v = NamedVar(a->left());
+        ArithmeticExpr *red = dynamic_cast<ArithmeticExpr*>(a->right());
+        const char *op = red == NULL ? "" : red->op()->lexeme();
+        if (v == NULL || !v->IsLocal() || v == vl.index || red == NULL ||
+            red->left() == NULL || NamedVar(red->left()) != v ||
+            (strcmp(op, "+") != 0 &&
+             (strcmp(op, "*") != 0 || v->type() != Type::intType)) ||
+            CountReads(body, v) != 2) {
+            return "writes a scalar that is not a reduction";
+        }
+        if (v->type() == Type::doubleType &&
+            GetOption("fast-math", 0) == 0) {
+            return "double reduction would reorder rounding";
+        }
+        if (!IsVectorOperand(red->right(), &vl)) {
+            return vl.reason;
+        }
+    }
+    if (vl.elem == NULL) {
+        return "no array elements to process";
+    }
+
+    int lanes = (vl.elem == Type::intType ? 8 : 4);
+    IntConstant *from = dynamic_cast<IntConstant*>(in->right());
+    IntConstant *to = dynamic_cast<IntConstant*>(cmp->right());
+    if (from != NULL && to != NULL) {
+        int trip = to->value() - from->value() +
+                   (strcmp(cmp->op()->lexeme(), "<=") == 0);
+        if (trip < lanes / 2) {
+            return "trip count is below the vector width";
+        }
+    }
+    lanes_ = lanes;
+
+    return NULL;
+}
+
+int ForStmt::lanes(void)
+{
+    return lanes_;
 }
 
 WhileStmt::WhileStmt(Expr *test, Stmt *body) : LoopStmt(test, body)
@@ -198,6 +1749,17 @@ WhileStmt::WhileStmt(Expr *test, Stmt *body) : LoopStmt(test, body)
     return;
 }
 
+int WhileStmt::Save(AstWriter *w)
+{
+    int t = w->Save(test);
+    int b = w->Save(body);
+    int r = w->Begin(AstWhileStmt, NULL);
+    w->Put(t);
+    w->Put(b);
+
+    return r;
+}
+
 IfStmt::IfStmt(Expr *t, Stmt *tb, Stmt *eb): ConditionalStmt(t, tb)
 {
     Assert(t != NULL && tb != NULL); // else can be NULL
@@ -205,12 +1767,44 @@ IfStmt::IfStmt(Expr *t, Stmt *tb, Stmt *eb): ConditionalStmt(t, tb)
     if (elseBody) elseBody->set_parent(this);
 }
 
+int IfStmt::Save(AstWriter *w)
+{
+    int t = w->Save(test);
+    int b = w->Save(body);
+    int e = w->Save(elseBody);
+    int r = w->Begin(AstIfStmt, NULL);
+    w->Put(t);
+    w->Put(b);
+    w->Put(e);
+
+    return r;
+}
+
+Stmt *IfStmt::GetElse(void)
+{
+    return elseBody;
+}
+
 void IfStmt::DoCheck(void)
 {
     ConditionalStmt::DoCheck();
     if (elseBody != NULL) {
         elseBody->Check();
+        BoolConstant *known = dynamic_cast<BoolConstant*>(test);
+        if (known != NULL && known->value()) {
+            elseBody->MarkDead();
+        }
+    }
+    return;
+}
+
+void IfStmt::GetChildren(List<Node*> *children)
+{
+    ConditionalStmt::GetChildren(children);
+    if (elseBody != NULL && !elseBody->dead()) {
+        children->Append(elseBody);
     }
+
     return;
 }
 
@@ -219,6 +1813,11 @@ BreakStmt::BreakStmt(yyltype loc) : Stmt(loc)
     return;
 }
 
+int BreakStmt::Save(AstWriter *w)
+{
+    return w->Begin(AstBreakStmt, location_);
+}
+
 void BreakStmt::DoCheck(void)
 {
     Stmt *cnt = GetContextStmt();
@@ -234,9 +1833,19 @@ ReturnStmt::ReturnStmt(yyltype loc, Expr *e) : Stmt(loc)
     (expr=e)->set_parent(this);
 }
 
+int ReturnStmt::Save(AstWriter *w)
+{
+    int e = w->Save(expr);
+    int r = w->Begin(AstReturnStmt, location_);
+    w->Put(e);
+
+    return r;
+}
+
 void ReturnStmt::DoCheck(void)
 {
     expr->Check();
+    expr = expr->Folded();
     // Try to find function declaration
     FnDecl *fnd = GetCurrentFn();
     if (fnd != NULL) {
@@ -251,16 +1860,33 @@ void ReturnStmt::DoCheck(void)
     return;
 }
 
+void ReturnStmt::GetChildren(List<Node*> *children)
+{
+    children->Append(expr);
+
+    return;
+}
+
 PrintStmt::PrintStmt(List<Expr*> *a)
 {
     Assert(a != NULL);
     (args=a)->set_parent_all(this);
 }
 
+int PrintStmt::Save(AstWriter *w)
+{
+    int a = w->SaveList(args);
+    int r = w->Begin(AstPrintStmt, NULL);
+    w->Put(a);
+
+    return r;
+}
+
 void PrintStmt::DoCheck(void)
 {
-    for (int i = 0; i < args->NumElements(); i++) {
-        args->Nth(i)->Check();
+    for (Expr *&arg : *args) {
+        arg->Check();
+        arg = arg->Folded();
     }
 
     // type checking. Print can only print string, int or bool
@@ -276,3 +1902,12 @@ void PrintStmt::DoCheck(void)
 
     return;
 }
+
+void PrintStmt::GetChildren(List<Node*> *children)
+{
+    for (Expr *arg : *args) {
+        children->Append(arg);
+    }
+
+    return;
+}
@@ -25,11 +25,23 @@ class ClassDecl;
 class InterfaceDecl;
 class NamedType;
 class Expr;
+class Call;
+struct CallGraph;
 
 class Program : public Node
 {
     private:
         Hashtable<Decl*> *sym_table_;
+        List<Call*> *call_sites_; // dynamically dispatched calls
+        List<Decl*> *imports_;    // from other programs' interfaces
+        List<const char*> *import_files_; // the file of each import
+
+        void GetClasses(List<ClassDecl*> *classes);
+        const char *ImportedFrom(Decl *d);
+        void EstimateFrequencies(CallGraph *g);
+        void ApplyProfile(CallGraph *g);
+        void OptimizeFns(CallGraph *g, int hot);
+        void Inline(CallGraph *g);
 
     protected:
         List<Decl*> *decls_;
@@ -37,20 +49,52 @@ class Program : public Node
 
     public:
         Program(List<Decl*> *decls);
-
-        ClassDecl *GetClass(NamedType *t);
+        int Save(AstWriter *w);
+
+        // Declare the classes, interfaces, functions and globals of a
+        // library's interface (see SaveInterface), read from file, in
+        // this program; call before Check(). Imports are checked and
+        // laid out with the program but have no code of their own to
+        // optimize.
+        void Import(Program *library, const char *file);
+
+        // Compute object layouts and classify dynamic call sites;
+        // only meaningful after a clean Check()
+        void Layout(void);
+        // Run the per-function analyses over the laid out program
+        void Optimize(void);
+        void AddCallSite(Call *c);
+        Program *GetProgram(void);
+        void GetChildren(List<Node*> *children);
+
+        Decl *GetTypeDecl(NamedType *t);
         FnDecl *GetFn(Identifier *id);
         VarDecl *GetVar(Identifier *id);
-        InterfaceDecl *GetInterface(NamedType *t);
 };
 
 class Stmt : public Node
 {
+    private:
+        bool dead_; // behind a constant test that never selects it
+        bool cold_; // rarely run according to the profile
+
 	protected:
 		virtual Stmt *GetContextStmt(void); // Get context of stmt of interest
     public:
         Stmt(void);
         Stmt(yyltype loc);
+
+        // Dead statements are left out of GetChildren, so the phases
+        // after checking never see them
+        bool dead(void);
+        void MarkDead(void);
+        // Cold code is laid out after the hot path
+        bool cold(void);
+        void MarkCold(void);
+
+        // Drop provably redundant array bounds checks below this node;
+        // returns how many were removed
+        virtual int EliminateBoundsChecks(void);
 };
 
 class StmtBlock : public Stmt
@@ -66,6 +110,9 @@ class StmtBlock : public Stmt
     public:
         StmtBlock(List<VarDecl*> *variableDeclarations,
                   List<Stmt*> *statements);
+        int Save(AstWriter *w);
+
+        void GetChildren(List<Node*> *children);
 
         VarDecl *GetVar(Identifier *id);
 };
@@ -79,31 +126,63 @@ class ConditionalStmt : public Stmt
 
     public:
         ConditionalStmt(Expr *testExpr, Stmt *body);
+
+        Expr *GetTest(void);
+        Stmt *GetBody(void);
+        void GetChildren(List<Node*> *children);
 };
 
 class LoopStmt : public ConditionalStmt
 {
+    private:
+        int unroll_; // copies of the body per iteration
+
 	protected:
 		Stmt *GetContextStmt(void); // Return LoopStmt
+        // The parts evaluated on every iteration
+        virtual void GetIteratedParts(List<Node*> *parts);
 
     public:
         LoopStmt(Expr *testExpr, Stmt *body);
+
+        // Mark loop-invariant expressions for hoisting into the loop
+        // preheader and induction-variable products and addresses for
+        // strength reduction. Inner loops should go first.
+        void HoistInvariants(int *hoisted, int *reduced);
+        int unroll(void);
+        void set_unroll(int n);
 };
 
 class ForStmt : public LoopStmt
 {
+    private:
+        int lanes_; // vector lanes on the AVX2 path, 0 if scalar
+
     protected:
         Expr *init, *step;
         void DoCheck(void);
+        void GetIteratedParts(List<Node*> *parts);
 
     public:
         ForStmt(Expr *init, Expr *test, Expr *step, Stmt *body);
+        int Save(AstWriter *w);
+
+        void GetChildren(List<Node*> *children);
+        int EliminateBoundsChecks(void);
+
+        // Decide whether the loop can run as SIMD code, selected by a
+        // CPU check between an AVX2 and an SSE2 body of half the width,
+        // with a scalar loop for the remainder. Returns NULL if so, or
+        // why not.
+        const char *Vectorize(void);
+        int lanes(void);
 };
 
 class WhileStmt : public LoopStmt
 {
     public:
         WhileStmt(Expr *test, Stmt *body);
+        int Save(AstWriter *w);
 };
 
 class IfStmt : public ConditionalStmt
@@ -116,6 +195,10 @@ class IfStmt : public ConditionalStmt
 
     public:
         IfStmt(Expr *test, Stmt *thenBody, Stmt *elseBody);
+        int Save(AstWriter *w);
+
+        Stmt *GetElse(void); // NULL without an else branch
+        void GetChildren(List<Node*> *children);
 };
 
 class BreakStmt : public Stmt
@@ -125,6 +208,7 @@ class BreakStmt : public Stmt
 
     public:
         BreakStmt(yyltype loc);
+        int Save(AstWriter *w);
 };
 
 class ReturnStmt : public Stmt
@@ -137,6 +221,9 @@ class ReturnStmt : public Stmt
 
     public:
         ReturnStmt(yyltype loc, Expr *expr);
+        int Save(AstWriter *w);
+
+        void GetChildren(List<Node*> *children);
 };
 
 class PrintStmt : public Stmt
@@ -147,6 +234,9 @@ class PrintStmt : public Stmt
 
     public:
         PrintStmt(List<Expr*> *arguments);
+        int Save(AstWriter *w);
+
+        void GetChildren(List<Node*> *children);
 };
 
 #endif
@@ -5,6 +5,8 @@
 #include "ast_type.h"
 #include "ast_decl.h"
 #include "errors.h"
+#include "astcache.h"
+#include "xref.h"
 
 /*** class Type ******************************************************/
 
@@ -26,7 +28,7 @@ Type::Type(void) : Node()
 Type::Type(const char *n)
 {
     Assert(n);
-    name_ = strdup(n);
+    name_ = CountedStrdup(NameMem, n);
     is_valid_ = true;
 
     return;
@@ -39,6 +41,14 @@ Type::Type(yyltype loc) : Node(loc)
     return;
 }
 
+int Type::Save(AstWriter *w)
+{
+    int r = w->Begin(AstBuiltinType, location_);
+    w->PutString(name_); // found again by name when loaded
+
+    return r;
+}
+
 char *Type::name(void)
 {
     return name_;
@@ -56,6 +66,35 @@ bool Type::is_valid(void)
     return is_valid_;
 }
 
+int Type::Size(void)
+{
+    int sz;
+
+    if (this == Type::doubleType) {
+        sz = 8;
+    } else if (this == Type::boolType) {
+        sz = 1;
+    } else if (this == Type::intType) {
+        sz = 4;
+    } else {
+        sz = wordSize; // string, arrays and objects are references
+    }
+
+    return sz;
+}
+
+int Type::Alignment(void)
+{
+    return Size(); // all scalar sizes are powers of two
+}
+
+bool Type::IsReference(void)
+{
+    return (this == Type::stringType ||
+            dynamic_cast<NamedType*>(this) != NULL ||
+            dynamic_cast<ArrayType*>(this) != NULL);
+}
+
 bool Type::IsEquivalentTo(Type *other)
 {
     return (this == Type::errorType ||
@@ -73,9 +112,13 @@ bool Type::IsCompatibleWith(Type *other)
 
 void NamedType::DoCheck(void)
 {
-    if (GetClass(this) == NULL && GetInterface(this) == NULL) {
+    Decl *d = GetTypeDecl(this);
+    if (dynamic_cast<ClassDecl*>(d) == NULL &&
+        dynamic_cast<InterfaceDecl*>(d) == NULL) {
         ReportError::IdentifierNotDeclared(id_, LookingForType);
         is_valid_ = false;
+    } else {
+        RecordUse(XrefType, d, id_);
     }
 
     return;
@@ -91,6 +134,15 @@ NamedType::NamedType(Identifier *i) : Type(*i->location())
     return;
 }
 
+int NamedType::Save(AstWriter *w)
+{
+    int id = w->Save(id_);
+    int r = w->Begin(AstNamedType, NULL);
+    w->Put(id);
+
+    return r;
+}
+
 Identifier *NamedType::id(void)
 {
     return id_;
@@ -136,6 +188,7 @@ ArrayType::ArrayType(Type *t) : Type()
     (elem_ = t)->set_parent(this);
     name_ = strdup(elem_->name());
     name_ = (char*)realloc(name_, strlen(name_) + 3);
+    CountAlloc(NameMem, strlen(name_) + 3);
     if (name_ == NULL) {
         exit(137);
     }
@@ -150,6 +203,7 @@ ArrayType::ArrayType(yyltype loc, Type *t) : Type(loc)
     (elem_ = t)->set_parent(this);
     name_ = strdup(elem_->name());
     name_ = (char*)realloc(name_, strlen(name_) + 3);
+    CountAlloc(NameMem, strlen(name_) + 3);
     if (name_ == NULL) {
         exit(137);
     }
@@ -158,6 +212,15 @@ ArrayType::ArrayType(yyltype loc, Type *t) : Type(loc)
     return;
 }
 
+int ArrayType::Save(AstWriter *w)
+{
+    int elem = w->Save(elem_);
+    int r = w->Begin(AstArrayType, location_);
+    w->Put(elem);
+
+    return r;
+}
+
 Type *ArrayType::elem(void)
 {
     return elem_;
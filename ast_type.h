@@ -24,13 +24,22 @@ class Type : public Node
         static Type *stringType;
         static Type *errorType;
 
+        // Every reference (string, array, object, vtable) occupies one
+        // machine word on the target.
+        static const int wordSize = 4;
+
         Type(void);
         Type(const char *str);
         Type(yyltype loc);
+        int Save(AstWriter *w); // only the built-in types
 
         char *name(void);
         bool is_valid(void);
 
+        int Size(void);      // bytes taken by a variable of this type
+        int Alignment(void); // required alignment of such a variable
+        bool IsReference(void); // points into the collected heap
+
         friend std::ostream& operator<<(std::ostream& out, Type *t);
 
         virtual bool IsEquivalentTo(Type *other); // return A==B
@@ -46,6 +55,7 @@ class NamedType : public Type
 
     public:
         NamedType(Identifier *i);
+        int Save(AstWriter *w);
 
         Identifier *id(void);
 
@@ -62,6 +72,7 @@ class ArrayType : public Type
     public:
         ArrayType(Type *t);
         ArrayType(yyltype loc, Type *t);
+        int Save(AstWriter *w);
 
         Type *elem(void);
 };
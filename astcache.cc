@@ -0,0 +1,716 @@
+/* File: astcache.cc
+ * -----------------
+ * Saving parsed programs to the AST cache and loading them back.
+ */
+
+#include "astcache.h"
+#include "ast.h"
+#include "ast_decl.h"
+#include "ast_expr.h"
+#include "ast_stmt.h"
+#include "ast_type.h"
+#include "scanner.h"  // for SetSavedLines
+#include "stringpool.h"
+#include "utility.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Bump whenever a record's fields change
+static const int AstFormat = 1;
+
+struct AstHeader {
+    char magic[8];                // "DCCAST\n\0"
+    int format;
+    int numWords;                 // records, including this header
+    unsigned long long key;       // of the source and the compiler
+    unsigned long long checksum;  // of everything after the header
+    int root;                     // the Program record
+    int stringsSize;              // bytes of strings after the words
+};
+
+static const int HeaderWords = sizeof(AstHeader) / sizeof(int);
+static const unsigned long long FnvBasis = 14695981039346656037ULL;
+static const int HasLocation = 1 << 8; // in the kind word of a record
+static const int LocationWords = 3;
+static const char Magic[8] = {'D', 'C', 'C', 'A', 'S', 'T', '\n', '\0'};
+
+static Type **builtinTypes[] = {
+    &Type::intType, &Type::doubleType, &Type::boolType, &Type::voidType,
+    &Type::nullType, &Type::stringType, &Type::errorType
+};
+static const int NumBuiltinTypes = 7;
+
+/*** Keys and file names *********************************************/
+
+static unsigned long long Fnv(unsigned long long h, const void *p, size_t n)
+{
+    const unsigned char *c = (const unsigned char*)p;
+
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ c[i]) * 1099511628211ULL;
+    }
+
+    return h;
+}
+
+// A hash of the source and of this dcc binary, so a rebuilt compiler
+// never reads files written by another
+static unsigned long long CacheKey(const std::string &source)
+{
+    unsigned long long h = FnvBasis;
+    struct stat st;
+
+    h = Fnv(h, &AstFormat, sizeof(AstFormat));
+    if (stat("/proc/self/exe", &st) == 0) {
+        h = Fnv(h, &st.st_size, sizeof(st.st_size));
+        h = Fnv(h, &st.st_mtime, sizeof(st.st_mtime));
+    }
+
+    return Fnv(h, source.data(), source.size());
+}
+
+// Interfaces outlive the compiler that wrote them, so their key only
+// changes with the format
+static unsigned long long InterfaceKey(void)
+{
+    return Fnv(Fnv(FnvBasis, "interface", 9), &AstFormat, sizeof(AstFormat));
+}
+
+// The key of images that do not depend on a source, for declarations
+static unsigned long long DeclKey(void)
+{
+    static unsigned long long key = Fnv(CacheKey(""), "decl", 4);
+
+    return key;
+}
+
+static std::string CachePath(unsigned long long key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.ast", key);
+
+    return std::string(GetStringOption("ast-cache")) + name;
+}
+
+/*** class AstWriter *************************************************/
+
+AstWriter::AstWriter(bool signaturesOnly, int lineOrigin)
+{
+    words_.resize(HeaderWords);
+    strings_.push_back('\0'); // offset 0 is the empty string
+    signatures_ = signaturesOnly;
+    lineOrigin_ = lineOrigin;
+    ok_ = true;
+
+    return;
+}
+
+bool AstWriter::signatures_only(void)
+{
+    return signatures_;
+}
+
+int AstWriter::Save(Node *n)
+{
+    return n == NULL ? 0 : n->Save(this);
+}
+
+int AstWriter::Begin(AstKind kind, yyltype *loc)
+{
+    int r = words_.size();
+    Put(loc == NULL ? kind : kind | HasLocation);
+    if (loc != NULL) {
+        PutLocation(loc);
+    }
+
+    return r;
+}
+
+void AstWriter::Put(int word)
+{
+    words_.push_back(word);
+
+    return;
+}
+
+void AstWriter::PutDouble(double d)
+{
+    int w[2];
+    memcpy(w, &d, sizeof(d));
+    Put(w[0]);
+    Put(w[1]);
+
+    return;
+}
+
+void AstWriter::PutString(const char *s)
+{
+    std::map<std::string, int>::iterator it = stringIndex_.find(s);
+
+    if (it == stringIndex_.end()) {
+        it = stringIndex_.insert(std::make_pair(std::string(s),
+                                                (int)strings_.size())).first;
+        strings_.append(s, strlen(s) + 1);
+    }
+    Put(it->second);
+
+    return;
+}
+
+// Both columns share a word; longer lines are not cached
+void AstWriter::PutLocation(yyltype *loc)
+{
+    if (loc->first_column < 0 || loc->first_column > 0xffff ||
+        loc->last_column < 0 || loc->last_column > 0xffff) {
+        Unsupported();
+    }
+    Put(loc->first_line - lineOrigin_);
+    Put(loc->last_line == 0 ? 0 : loc->last_line - lineOrigin_);
+    Put(loc->first_column | loc->last_column << 16);
+
+    return;
+}
+
+void AstWriter::Unsupported(void)
+{
+    ok_ = false;
+
+    return;
+}
+
+bool AstWriter::Finish(int root, unsigned long long key, std::string *image)
+{
+    AstHeader h;
+
+    if (!ok_) {
+        return false;
+    }
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, Magic, sizeof(Magic));
+    h.format = AstFormat;
+    h.numWords = words_.size();
+    h.key = key;
+    h.root = root;
+    h.stringsSize = strings_.size();
+
+    image->assign((const char*)&words_[0], words_.size() * sizeof(int));
+    image->append(strings_);
+    h.checksum = Fnv(FnvBasis, image->data() + sizeof(h),
+                     image->size() - sizeof(h));
+    image->replace(0, sizeof(h), (const char*)&h, sizeof(h));
+
+    return true;
+}
+
+/*** Loading *********************************************************/
+
+/* Rebuilds a tree from the records of a mapped file. Every reference is
+ * checked to lie inside the file and before the record holding it, so
+ * a damaged file fails the load instead of crashing or looping.
+ */
+class AstReader
+{
+    private:
+        const int *words_;
+        int numWords_;
+        const char *strings_;
+        int stringsSize_;
+        std::vector<bool> loaded_; // each record is used by one parent
+        int lineOrigin_;
+        bool ok_;
+
+        int Word(int at);
+        const char *String(int at);
+        bool Location(int at, yyltype *loc);
+        template<class T> T *Load(int from, int ref, bool optional);
+        template<class T> List<T*> *LoadList(int from, int ref);
+        Node *Build(int ref);
+
+    public:
+        AstReader(const char *image, int numWords, int stringsSize,
+                  int lineOrigin = 0);
+        Program *LoadProgram(int root);
+        Decl *LoadDecl(int root);
+};
+
+AstReader::AstReader(const char *image, int numWords, int stringsSize,
+                     int lineOrigin)
+{
+    words_ = (const int*)image;
+    numWords_ = numWords;
+    strings_ = image + numWords * sizeof(int);
+    stringsSize_ = stringsSize;
+    loaded_.resize(numWords);
+    lineOrigin_ = lineOrigin;
+    ok_ = true;
+
+    return;
+}
+
+int AstReader::Word(int at)
+{
+    if (at < HeaderWords || at >= numWords_) {
+        ok_ = false;
+        return 0;
+    }
+
+    return words_[at];
+}
+
+const char *AstReader::String(int at)
+{
+    int offset = Word(at);
+
+    if (offset < 0 || offset >= stringsSize_ ||
+        memchr(strings_ + offset, '\0', stringsSize_ - offset) == NULL) {
+        ok_ = false;
+        return "";
+    }
+
+    return strings_ + offset;
+}
+
+// The location of the record at r; false if it was saved without one
+bool AstReader::Location(int r, yyltype *loc)
+{
+    memset(loc, 0, sizeof(*loc));
+    if ((Word(r) & HasLocation) == 0) {
+        return false;
+    }
+    loc->first_line = Word(r + 1) + lineOrigin_;
+    loc->last_line = Word(r + 2);
+    if (loc->last_line != 0) { // the scanner leaves it 0
+        loc->last_line += lineOrigin_;
+    }
+    loc->first_column = Word(r + 3) & 0xffff;
+    loc->last_column = (unsigned)Word(r + 3) >> 16;
+
+    return true;
+}
+
+// The node a record at `from` refers to, which must be a T
+template<class T> T *AstReader::Load(int from, int ref, bool optional)
+{
+    if (ref == 0 && optional) {
+        return NULL;
+    }
+    if (ref < HeaderWords || ref >= from || loaded_[ref]) {
+        ok_ = false;
+        return NULL;
+    }
+    loaded_[ref] = true;
+
+    T *n = dynamic_cast<T*>(Build(ref));
+    if (n == NULL) {
+        ok_ = false;
+    }
+
+    return n;
+}
+
+template<class T> List<T*> *AstReader::LoadList(int from, int ref)
+{
+    List<T*> *list = new List<T*>;
+
+    if (ref < HeaderWords || ref >= from || loaded_[ref] ||
+        Word(ref) != AstList) {
+        ok_ = false;
+        return list;
+    }
+    loaded_[ref] = true;
+
+    int n = Word(ref + 1);
+    for (int i = 0; ok_ && i < n; i++) {
+        T *elem = Load<T>(ref, Word(ref + 2 + i), false);
+        if (elem != NULL) {
+            list->Append(elem);
+        }
+    }
+
+    return list;
+}
+
+Node *AstReader::Build(int r)
+{
+    yyltype loc;
+    bool hasLoc = Location(r, &loc);
+    int f = r + 1 + (hasLoc ? LocationWords : 0); // the first field
+    int kind = Word(r) & ~HasLocation;
+    Node *n = NULL;
+
+    switch (kind) {
+      case AstIdentifier:
+        n = new Identifier(loc, String(f));
+        break;
+      case AstBuiltinType: {
+        const char *name = String(f);
+        for (int i = 0; i < NumBuiltinTypes; i++) {
+            if (strcmp((*builtinTypes[i])->name(), name) == 0) {
+                n = *builtinTypes[i];
+            }
+        }
+        break;
+      }
+      case AstNamedType: {
+        Identifier *id = Load<Identifier>(r, Word(f), false);
+        n = ok_ ? new NamedType(id) : NULL;
+        break;
+      }
+      case AstArrayType: {
+        Type *elem = Load<Type>(r, Word(f), false);
+        if (ok_) {
+            n = hasLoc ? new ArrayType(loc, elem) : new ArrayType(elem);
+        }
+        break;
+      }
+      case AstVarDecl: {
+        Identifier *id = Load<Identifier>(r, Word(f), false);
+        Type *t = Load<Type>(r, Word(f + 1), false);
+        n = ok_ ? new VarDecl(id, t) : NULL;
+        break;
+      }
+      case AstClassDecl: {
+        Identifier *id = Load<Identifier>(r, Word(f), false);
+        NamedType *ext = Load<NamedType>(r, Word(f + 1), true);
+        List<NamedType*> *impl = LoadList<NamedType>(r, Word(f + 2));
+        List<Decl*> *members = LoadList<Decl>(r, Word(f + 3));
+        n = ok_ ? new ClassDecl(id, ext, impl, members) : NULL;
+        break;
+      }
+      case AstInterfaceDecl: {
+        Identifier *id = Load<Identifier>(r, Word(f), false);
+        List<Decl*> *members = LoadList<Decl>(r, Word(f + 1));
+        n = ok_ ? new InterfaceDecl(id, members) : NULL;
+        break;
+      }
+      case AstFnDecl: {
+        Identifier *id = Load<Identifier>(r, Word(f), false);
+        Type *ret = Load<Type>(r, Word(f + 1), false);
+        List<VarDecl*> *formals = LoadList<VarDecl>(r, Word(f + 2));
+        Stmt *body = Load<Stmt>(r, Word(f + 3), true);
+        if (ok_) {
+            FnDecl *f = new FnDecl(id, ret, formals);
+            if (body != NULL) {
+                f->set_body(body);
+            }
+            n = f;
+        }
+        break;
+      }
+      case AstEmptyExpr:
+        n = new EmptyExpr();
+        break;
+      case AstIntConstant:
+        n = new IntConstant(loc, Word(f));
+        break;
+      case AstDoubleConstant: {
+        int w[2] = {Word(f), Word(f + 1)};
+        double d;
+        memcpy(&d, w, sizeof(d));
+        n = new DoubleConstant(loc, d);
+        break;
+      }
+      case AstBoolConstant:
+        n = new BoolConstant(loc, Word(f) != 0);
+        break;
+      case AstStringConstant: {
+        const char *s = String(f);
+        n = new StringConstant(loc, InternString(s, strlen(s)));
+        break;
+      }
+      case AstNullConstant:
+        n = new NullConstant(loc);
+        break;
+      case AstOperator: {
+        const char *lexeme = String(f);
+        if (strlen(lexeme) < 4) {
+            n = new Operator(loc, lexeme);
+        }
+        break;
+      }
+      case AstArithmeticExpr: case AstRelationalExpr: case AstEqualityExpr:
+      case AstLogicalExpr: case AstAssignExpr: {
+        Expr *lhs = Load<Expr>(r, Word(f), true);
+        Operator *op = Load<Operator>(r, Word(f + 1), false);
+        Expr *rhs = Load<Expr>(r, Word(f + 2), false);
+        if (!ok_) {
+            break;
+        }
+        switch (kind) {
+          case AstArithmeticExpr:
+            n = lhs == NULL ? new ArithmeticExpr(op, rhs) :
+                              new ArithmeticExpr(lhs, op, rhs);
+            break;
+          case AstLogicalExpr:
+            n = lhs == NULL ? new LogicalExpr(op, rhs) :
+                              new LogicalExpr(lhs, op, rhs);
+            break;
+          case AstRelationalExpr:
+            n = lhs == NULL ? NULL : new RelationalExpr(lhs, op, rhs);
+            break;
+          case AstEqualityExpr:
+            n = lhs == NULL ? NULL : new EqualityExpr(lhs, op, rhs);
+            break;
+          default:
+            n = lhs == NULL ? NULL : new AssignExpr(lhs, op, rhs);
+            break;
+        }
+        break;
+      }
+      case AstThis:
+        n = new This(loc);
+        break;
+      case AstArrayAccess: {
+        Expr *base = Load<Expr>(r, Word(f), false);
+        Expr *subscript = Load<Expr>(r, Word(f + 1), false);
+        n = ok_ ? new ArrayAccess(loc, base, subscript) : NULL;
+        break;
+      }
+      case AstFieldAccess: {
+        Expr *base = Load<Expr>(r, Word(f), true);
+        Identifier *field = Load<Identifier>(r, Word(f + 1), false);
+        n = ok_ ? new FieldAccess(base, field) : NULL;
+        break;
+      }
+      case AstCall: {
+        Expr *base = Load<Expr>(r, Word(f), true);
+        Identifier *field = Load<Identifier>(r, Word(f + 1), false);
+        List<Expr*> *actuals = LoadList<Expr>(r, Word(f + 2));
+        n = ok_ ? new Call(loc, base, field, actuals) : NULL;
+        break;
+      }
+      case AstNewExpr: {
+        NamedType *t = Load<NamedType>(r, Word(f), false);
+        n = ok_ ? new NewExpr(loc, t) : NULL;
+        break;
+      }
+      case AstNewArrayExpr: {
+        Expr *size = Load<Expr>(r, Word(f), false);
+        Type *t = Load<Type>(r, Word(f + 1), false);
+        n = ok_ ? new NewArrayExpr(loc, size, t) : NULL;
+        break;
+      }
+      case AstReadIntegerExpr:
+        n = new ReadIntegerExpr(loc);
+        break;
+      case AstReadLineExpr:
+        n = new ReadLineExpr(loc);
+        break;
+      case AstProgram: {
+        List<Decl*> *decls = LoadList<Decl>(r, Word(f));
+        n = ok_ ? new Program(decls) : NULL;
+        break;
+      }
+      case AstStmtBlock: {
+        List<VarDecl*> *decls = LoadList<VarDecl>(r, Word(f));
+        List<Stmt*> *stmts = LoadList<Stmt>(r, Word(f + 1));
+        n = ok_ ? new StmtBlock(decls, stmts) : NULL;
+        break;
+      }
+      case AstIfStmt: {
+        Expr *test = Load<Expr>(r, Word(f), false);
+        Stmt *then = Load<Stmt>(r, Word(f + 1), false);
+        Stmt *otherwise = Load<Stmt>(r, Word(f + 2), true);
+        n = ok_ ? new IfStmt(test, then, otherwise) : NULL;
+        break;
+      }
+      case AstWhileStmt: {
+        Expr *test = Load<Expr>(r, Word(f), false);
+        Stmt *body = Load<Stmt>(r, Word(f + 1), false);
+        n = ok_ ? new WhileStmt(test, body) : NULL;
+        break;
+      }
+      case AstForStmt: {
+        Expr *init = Load<Expr>(r, Word(f), false);
+        Expr *test = Load<Expr>(r, Word(f + 1), false);
+        Expr *step = Load<Expr>(r, Word(f + 2), false);
+        Stmt *body = Load<Stmt>(r, Word(f + 3), false);
+        n = ok_ ? new ForStmt(init, test, step, body) : NULL;
+        break;
+      }
+      case AstBreakStmt:
+        n = new BreakStmt(loc);
+        break;
+      case AstReturnStmt: {
+        Expr *e = Load<Expr>(r, Word(f), false);
+        n = ok_ ? new ReturnStmt(loc, e) : NULL;
+        break;
+      }
+      case AstPrintStmt: {
+        List<Expr*> *args = LoadList<Expr>(r, Word(f));
+        n = ok_ ? new PrintStmt(args) : NULL;
+        break;
+      }
+    }
+    if (n == NULL) {
+        ok_ = false;
+    }
+
+    return n;
+}
+
+Program *AstReader::LoadProgram(int root)
+{
+    Program *p = Load<Program>(numWords_, root, false);
+
+    return ok_ ? p : NULL;
+}
+
+Decl *AstReader::LoadDecl(int root)
+{
+    Decl *d = Load<Decl>(numWords_, root, false);
+
+    return ok_ ? d : NULL;
+}
+
+// Whether size bytes at image are an intact file written with the key
+static bool ValidImage(const char *image, off_t size, unsigned long long key)
+{
+    const AstHeader *h = (const AstHeader*)image;
+
+    return (size >= (off_t)sizeof(AstHeader) &&
+            memcmp(h->magic, Magic, sizeof(Magic)) == 0 &&
+            h->format == AstFormat && h->key == key &&
+            h->numWords >= HeaderWords && h->stringsSize > 0 &&
+            (off_t)h->numWords * (off_t)sizeof(int) + h->stringsSize ==
+            size &&
+            Fnv(FnvBasis, image + sizeof(AstHeader),
+                size - sizeof(AstHeader)) == h->checksum);
+}
+
+// The program in an image file written with the given key, or NULL
+// if there is no such file or it is damaged; found tells which.
+static Program *LoadImage(const std::string &path, unsigned long long key,
+                          bool *found)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    Program *p = NULL;
+
+    *found = (fd >= 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(AstHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    void *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return NULL;
+    }
+
+    const AstHeader *h = (const AstHeader*)image;
+    if (ValidImage((const char*)image, st.st_size, key)) {
+        AstReader reader((const char*)image, h->numWords, h->stringsSize);
+        p = reader.LoadProgram(h->root);
+    }
+    munmap(image, st.st_size);
+
+    return p;
+}
+
+// Write and rename, so a concurrent reader never sees half a file
+static bool WriteImage(const std::string &image, const std::string &path)
+{
+    std::string temp = path + ".tmp";
+    FILE *f = fopen(temp.c_str(), "wb");
+
+    if (f == NULL) {
+        fprintf(stderr, "*** Cannot write %s: %s\n", temp.c_str(),
+                strerror(errno));
+        return false;
+    }
+    bool ok = fwrite(image.data(), 1, image.size(), f) == image.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "*** Cannot write %s: %s\n", path.c_str(),
+                strerror(errno));
+        unlink(temp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+Program *LoadCachedProgram(const std::string &source)
+{
+    std::string path = CachePath(CacheKey(source));
+    bool found;
+    Program *p = LoadImage(path, CacheKey(source), &found);
+
+    if (p == NULL && found) {
+        fprintf(stderr, "*** Ignoring damaged AST cache file %s\n",
+                path.c_str());
+    }
+    if (p != NULL) {
+        // As the scanner would have, so errors quote their lines
+        SetSavedLines(source.data(), source.size());
+    }
+
+    return p;
+}
+
+bool SaveDecl(Decl *decl, int line, std::string *image)
+{
+    AstWriter w(false, line);
+    int root = w.Save(decl);
+
+    return w.Finish(root, DeclKey(), image);
+}
+
+Decl *LoadDecl(const char *image, size_t size, int line)
+{
+    if (!ValidImage(image, size, DeclKey())) {
+        return NULL;
+    }
+    const AstHeader *h = (const AstHeader*)image;
+    AstReader reader(image, h->numWords, h->stringsSize, line);
+
+    return reader.LoadDecl(h->root);
+}
+
+bool SaveProgram(Program *program, const std::string &source,
+                 std::string *image)
+{
+    AstWriter w;
+    int root = w.Save(program);
+
+    return w.Finish(root, CacheKey(source), image);
+}
+
+void WriteCachedProgram(const std::string &image, const std::string &source)
+{
+    WriteImage(image, CachePath(CacheKey(source)));
+
+    return;
+}
+
+bool SaveInterface(Program *program, const char *path)
+{
+    AstWriter w(true);
+    std::string image;
+    int root = w.Save(program);
+
+    return w.Finish(root, InterfaceKey(), &image) && WriteImage(image, path);
+}
+
+Program *LoadInterface(const char *path)
+{
+    bool found;
+    Program *p = LoadImage(path, InterfaceKey(), &found);
+
+    if (p == NULL) {
+        Failure(found ? "%s is not a dcc interface file" :
+                "Cannot open interface file %s", path);
+    }
+
+    return p;
+}
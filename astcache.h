@@ -0,0 +1,161 @@
+/* File: astcache.h
+ * ----------------
+ * A cache of parsed programs, so unchanged sources skip scanning and
+ * parsing. With --ast-cache=dir, the tree of an input that checks
+ * without errors is saved under dir, named by a hash of the source and
+ * of the dcc binary, and the next run over the same source maps that
+ * file and rebuilds the tree from it.
+ *
+ * The file is a header, an array of 32-bit words holding one record per
+ * node, and a string table. A record is its kind, the location it was
+ * built with if any, and then its fields; a reference to another record
+ * is its word offset (0 for none), always to one written earlier, and
+ * an identifier is a byte offset into the string table. Nothing in the
+ * file depends on where it is mapped. The tree is saved as parsed,
+ * before checking, so a loaded program is checked as usual.
+ *
+ * The same records, without function bodies, make up the interface
+ * of a program written with --export-interface=file. Another program
+ * compiled with --import-interface=file[,file...] sees its classes,
+ * interfaces, functions and globals without their source. A program's
+ * interface does not include what it imported itself, so importers
+ * list every interface it depended on.
+ *
+ * Incremental reparsing (incremental.h) keeps an image of each
+ * top-level declaration by itself, with lines counted from its first.
+ */
+
+#ifndef _H_astcache
+#define _H_astcache
+
+#include <string>
+#include <map>
+#include <vector>
+#include "list.h"
+#include "location.h"
+
+class Node;
+class Decl;
+class Program;
+
+enum AstKind {
+    AstNone, AstList, AstIdentifier, AstBuiltinType, AstNamedType,
+    AstArrayType, AstVarDecl, AstClassDecl, AstInterfaceDecl, AstFnDecl,
+    AstEmptyExpr, AstIntConstant, AstDoubleConstant, AstBoolConstant,
+    AstStringConstant, AstNullConstant, AstOperator, AstArithmeticExpr,
+    AstRelationalExpr, AstEqualityExpr, AstLogicalExpr, AstAssignExpr,
+    AstThis, AstArrayAccess, AstFieldAccess, AstCall, AstNewExpr,
+    AstNewArrayExpr, AstReadIntegerExpr, AstReadLineExpr, AstProgram,
+    AstStmtBlock, AstIfStmt, AstWhileStmt, AstForStmt, AstBreakStmt,
+    AstReturnStmt, AstPrintStmt, NumAstKinds
+};
+
+/* Class: AstWriter
+ * ----------------
+ * Builds the records of a tree. Each node's Save writes its children
+ * first, then begins its own record and puts its fields, returning the
+ * reference Begin gave it.
+ */
+class AstWriter
+{
+    private:
+        std::vector<int> words_;
+        std::string strings_;
+        std::map<std::string, int> stringIndex_;
+        bool signatures_;
+        int lineOrigin_;
+        bool ok_;
+
+        void PutLocation(yyltype *loc); // NULL allowed
+
+    public:
+        // Lines are saved less lineOrigin, to load at another line
+        AstWriter(bool signaturesOnly = false, int lineOrigin = 0);
+
+        bool signatures_only(void); // leave out function bodies
+
+        int Save(Node *n); // 0 for NULL
+        template<class T> int SaveList(List<T> *list);
+
+        // loc is NULL for nodes that take theirs from their children
+        int Begin(AstKind kind, yyltype *loc);
+        void Put(int word);
+        void PutDouble(double d);
+        void PutString(const char *s);
+        void Unsupported(void); // the tree cannot be saved
+
+        // The file image for a tree rooted at the given record
+        bool Finish(int root, unsigned long long key, std::string *image);
+};
+
+template<class T> int AstWriter::SaveList(List<T> *list)
+{
+    std::vector<int> refs;
+    for (T elem : *list) {
+        refs.push_back(Save(elem));
+    }
+
+    int r = words_.size();
+    Put(AstList);
+    Put(refs.size());
+    for (size_t i = 0; i < refs.size(); i++) {
+        Put(refs[i]);
+    }
+
+    return r;
+}
+
+
+/* Function: LoadCachedProgram()
+ * -----------------------------
+ * The program cached for this source, or NULL if there is none or the
+ * file is stale or damaged. When there is one, the lines of the source
+ * are saved for error messages as if it had been scanned.
+ */
+Program *LoadCachedProgram(const std::string &source);
+
+
+/* Function: SaveProgram()
+ * -----------------------
+ * Serialize a program just parsed from the source, before it is
+ * checked, into the image to cache. False if it cannot be saved.
+ */
+bool SaveProgram(Program *program, const std::string &source,
+                 std::string *image);
+
+
+/* Function: WriteCachedProgram()
+ * ------------------------------
+ * Store an image from SaveProgram in the cache directory.
+ */
+void WriteCachedProgram(const std::string &image, const std::string &source);
+
+
+/* Function: SaveDecl(), LoadDecl()
+ * ----------------------------------
+ * The image of one top-level declaration beginning on the given line,
+ * as incremental reparsing keeps them, with lines saved relative to
+ * that one; and the declaration rebuilt from an image to begin on a
+ * line. LoadDecl returns NULL if the image is damaged or was saved by
+ * another build of dcc.
+ */
+bool SaveDecl(Decl *decl, int line, std::string *image);
+Decl *LoadDecl(const char *image, size_t size, int line);
+
+
+/* Function: SaveInterface()
+ * -------------------------
+ * Write the declarations of a checked program, without function
+ * bodies, to an interface file. False if it could not be written.
+ */
+bool SaveInterface(Program *program, const char *path);
+
+
+/* Function: LoadInterface()
+ * -------------------------
+ * The declarations of an interface file, for Program::Import. Fails
+ * if the file is missing or is not an interface.
+ */
+Program *LoadInterface(const char *path);
+
+#endif
@@ -0,0 +1,868 @@
+/* File: fuzzcost.cc
+ * -----------------
+ * Hunts for Decaf programs that dcc compiles in more than linear time.
+ * Starting from the programs in a seeds directory, it mutates them
+ * along the productions of parser.y, so mutants stay mostly well
+ * formed, and compiles each mutant with dcc, measuring the median
+ * compile time (-ftime-report) and the allocations (--mem-snapshot)
+ * per byte of input. Those costlier than a threshold, and by a tenth
+ * than any kept before, are kept in the corpus directory and listed
+ * with their costs in its costs.txt, a regression corpus of worst
+ * cases. Options, written as for dcc:
+ *
+ *   -fdcc=path           compiler to measure                     (./dcc)
+ *   -fseeds=dir          programs to start from                  (samples)
+ *   -fcorpus=dir         where costly inputs are kept       (bench/corpus)
+ *   -fiterations=N       mutants to compile                      (500)
+ *   -fseed=N             random seed                             (1)
+ *   -fruns=N             compiles of each, for the median time   (3)
+ *   -fns-per-byte=N      keep inputs taking this long per byte   (1500)
+ *   -fallocs-per-kb=N    or making this many allocations per KB  (1200)
+ *   -fmin-bytes=N        smallest input kept                     (512)
+ *   -fmax-bytes=N        largest mutant compiled                 (32768)
+ *   -ftimeout=N          CPU seconds before a compile is cut off (20)
+ *
+ * The thresholds are about twice what the workloads of bench/run.sh
+ * cost. With -freplay, nothing is mutated: every input in costs.txt is
+ * measured again and compared with its recorded costs, as bench/run.sh
+ * does with its baseline. Allocations replay exactly, so an input
+ * making more than -ftolerance=N percent (25) more is marked and makes
+ * it fail. Times vary by up to 40% from one replay to the next, so
+ * they fail it only past -ftime-tolerance=N percent (100), a cost
+ * that has doubled. With -fupdate costs.txt is rewritten from the new
+ * measurements.
+ *
+ * -d fuzzcost prints the costs of every mutant. The mutations, each
+ * named for the production it adds to:
+ *
+ *   ClassDecl  a subclass of a class, overriding its methods
+ *   OptImpl    a new interface that a class implements
+ *   FieldAccess a field of a class's own type and a chain through it
+ *   StmtBlock  the contents of a block nested in a block, if or while
+ *   Expr       a constant replaced by an expression of constants
+ *   DeclList   a top-level declaration copied under a new name
+ *   StmtList   a statement repeated
+ *
+ * so that long inheritance chains, wide interface sets, a.b.c.d chains
+ * and deeply nested blocks all grow from whatever the seeds hold. The
+ * first four are made four times as often as the others, which only
+ * make an input denser.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "utility.h"
+
+struct Token {
+    std::string text;
+    size_t offset;
+};
+
+struct Input {
+    std::string name, text;
+    double nsPerByte, allocsPerKb;
+};
+
+static std::mt19937 rng;
+static std::string work; // directory for the input, report and snapshot
+static int fresh = 0;    // for new identifiers
+static double fixedNs = 0, fixedAllocations = 0; // of an empty compile
+
+static int Random(int n)
+{
+    return std::uniform_int_distribution<int>(0, n - 1)(rng);
+}
+
+/* Function: Tokenize()
+ * --------------------
+ * The tokens of a program, as far as the mutations need them: comments
+ * are skipped, a string literal is one token and the operators of two
+ * characters are kept together.
+ */
+static std::vector<Token> Tokenize(const std::string &s)
+{
+    std::vector<Token> tokens;
+    size_t i = 0;
+
+    while (i < s.size()) {
+        size_t start = i;
+        char c = s[i];
+        if (isspace((unsigned char)c)) {
+            i++;
+            continue;
+        } else if (s.compare(i, 2, "//") == 0) {
+            i = s.find('\n', i);
+            i = (i == std::string::npos ? s.size() : i);
+            continue;
+        } else if (s.compare(i, 2, "/*") == 0) {
+            i = s.find("*/", i + 2);
+            i = (i == std::string::npos ? s.size() : i + 2);
+            continue;
+        } else if (c == '"') {
+            i = s.find_first_of("\"\n", i + 1);
+            i = (i == std::string::npos ? s.size() : i + 1);
+        } else if (isalnum((unsigned char)c) || c == '_') {
+            while (i < s.size() && (isalnum((unsigned char)s[i]) ||
+                                    s[i] == '_' || (s[i] == '.' &&
+                                    isdigit((unsigned char)c)))) {
+                i++;
+            }
+        } else if (strchr("<>=!&|[", c) != NULL && i + 1 < s.size() &&
+                   strchr("=&|]", s[i + 1]) != NULL) {
+            i += 2;
+        } else {
+            i++;
+        }
+        Token t = { s.substr(start, i - start), start };
+        tokens.push_back(t);
+    }
+
+    return tokens;
+}
+
+// The index of the token closing the bracket at open, or -1
+static int Matching(const std::vector<Token> &t, int open)
+{
+    const std::string &o = t[open].text;
+    std::string c = (o == "{" ? "}" : o == "(" ? ")" : "]");
+    int depth = 0;
+
+    for (int i = open; i < (int)t.size(); i++) {
+        if (t[i].text == o) {
+            depth++;
+        } else if (t[i].text == c && --depth == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static bool IsIdentifier(const std::string &s)
+{
+    static const char *keywords[] = {
+        "void", "int", "double", "bool", "string", "class", "interface",
+        "null", "this", "extends", "implements", "for", "while", "if",
+        "else", "return", "break", "New", "NewArray", "Print",
+        "ReadInteger", "ReadLine", "true", "false", NULL
+    };
+
+    if (s.empty() || !isalpha((unsigned char)s[0])) {
+        return false;
+    }
+    for (int i = 0; keywords[i] != NULL; i++) {
+        if (s == keywords[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static std::string Fresh(const char *prefix)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%s%d", prefix, fresh++);
+
+    return buf;
+}
+
+// A top-level declaration: its first and last tokens, its name, and
+// for a class or interface the braces of its body
+struct Decl {
+    int first, last, name, open;
+    bool isClass, isInterface;
+};
+
+static std::vector<Decl> TopLevel(const std::vector<Token> &t)
+{
+    std::vector<Decl> decls;
+
+    for (int i = 0; i < (int)t.size(); ) {
+        Decl d = { i, -1, -1, -1, t[i].text == "class",
+                   t[i].text == "interface" };
+        int j = i;
+        while (j < (int)t.size() && t[j].text != "{" && t[j].text != ";") {
+            if (d.name < 0 && j > i && IsIdentifier(t[j].text) &&
+                (d.isClass || d.isInterface || j + 1 == (int)t.size() ||
+                 t[j + 1].text == "(" || t[j + 1].text == ";")) {
+                d.name = j;
+            }
+            j++;
+        }
+        if (j == (int)t.size()) {
+            break;
+        }
+        d.last = (t[j].text == ";" ? j : Matching(t, j));
+        d.open = (t[j].text == "{" ? j : -1);
+        if (d.last < 0) {
+            break;
+        }
+        if (d.name >= 0) {
+            decls.push_back(d);
+        }
+        i = d.last + 1;
+    }
+
+    return decls;
+}
+
+static std::vector<Decl> Classes(const std::vector<Token> &t)
+{
+    std::vector<Decl> all = TopLevel(t), classes;
+
+    for (size_t i = 0; i < all.size(); i++) {
+        if (all[i].isClass) {
+            classes.push_back(all[i]);
+        }
+    }
+
+    return classes;
+}
+
+// A class to grow: the last one half of the time, so growth piles up
+static bool PickClass(const std::vector<Token> &t, Decl *d)
+{
+    std::vector<Decl> classes = Classes(t);
+
+    if (classes.empty()) {
+        return false;
+    }
+    *d = classes[Random(2) == 0 ? classes.size() - 1 :
+                 Random(classes.size())];
+
+    return true;
+}
+
+static std::string Text(const std::string &s, const std::vector<Token> &t,
+                        int first, int last)
+{
+    size_t end = t[last].offset + t[last].text.size();
+
+    return s.substr(t[first].offset, end - t[first].offset);
+}
+
+/* Function: Subclass()
+ * --------------------
+ * ClassDecl: class N extends C { ... } with C's methods copied into
+ * it, so each overrides one of C's.
+ */
+static bool Subclass(std::string *s)
+{
+    std::vector<Token> t = Tokenize(*s);
+    Decl c;
+
+    if (!PickClass(t, &c)) {
+        return false;
+    }
+    std::string body;
+    for (int i = c.open + 1; i < c.last; ) {
+        int j = i;
+        while (j < c.last && t[j].text != ";" && t[j].text != "{") {
+            j++;
+        }
+        if (j < c.last && t[j].text == "{") {
+            int close = Matching(t, j);
+            body += "  " + Text(*s, t, i, close) + "\n";
+            j = close;
+        }
+        i = j + 1;
+    }
+    *s += "\nclass " + Fresh("Sub") + " extends " + t[c.name].text +
+          " {\n" + body + "}\n";
+
+    return true;
+}
+
+/* Function: Implement()
+ * ---------------------
+ * OptImpl: a new interface with one method, added to a class's
+ * implements list and implemented in its body.
+ */
+static bool Implement(std::string *s)
+{
+    std::vector<Token> t = Tokenize(*s);
+    Decl c;
+
+    if (!PickClass(t, &c)) {
+        return false;
+    }
+    std::string intf = Fresh("Intf"), method = Fresh("im");
+    bool listed = false;
+    for (int i = c.first; i < c.open; i++) {
+        listed = listed || t[i].text == "implements";
+    }
+    std::string copy = *s;
+    copy.insert(t[c.last].offset, "  int " + method +
+                "(int a) { return a; }\n");
+    copy.insert(t[c.open].offset, (listed ? ", " : "implements ") + intf +
+                " ");
+    *s = "interface " + intf + " {\n  int " + method + "(int a);\n}\n" + copy;
+
+    return true;
+}
+
+/* Function: Chain()
+ * -----------------
+ * FieldAccess: a field of a class's own type, and a method assigning
+ * through it three deep; or else, one link more on a chain already
+ * made.
+ */
+static bool Chain(std::string *s)
+{
+    std::vector<Token> t = Tokenize(*s);
+    std::vector<int> links;
+
+    for (int i = 0; i + 1 < (int)t.size(); i++) {
+        if (t[i].text == "." && t[i + 1].text.compare(0, 5, "chain") == 0) {
+            links.push_back(i);
+        }
+    }
+    if (!links.empty() && Random(4) != 0) {
+        int i = links[Random(links.size())];
+        s->insert(t[i].offset, "." + t[i + 1].text);
+        return true;
+    }
+
+    Decl c;
+    if (!PickClass(t, &c)) {
+        return false;
+    }
+    std::string field = Fresh("chain"), cls = t[c.name].text;
+    s->insert(t[c.last].offset, "  void " + Fresh("walk") + "() { " +
+              field + "." + field + "." + field + " = null; }\n");
+    s->insert(t[c.open].offset + 1, "\n  " + cls + " " + field + ";");
+
+    return true;
+}
+
+// The open braces of statement blocks: all but the bodies of classes
+// and interfaces
+static std::vector<int> Blocks(const std::vector<Token> &t)
+{
+    std::vector<Decl> decls = TopLevel(t);
+    std::vector<int> blocks;
+    size_t d = 0;
+
+    for (int i = 0; i < (int)t.size(); i++) {
+        while (d < decls.size() && decls[d].last < i) {
+            d++;
+        }
+        bool body = (d < decls.size() && decls[d].open == i &&
+                     (decls[d].isClass || decls[d].isInterface));
+        if (t[i].text == "{" && !body) {
+            blocks.push_back(i);
+        }
+    }
+
+    return blocks;
+}
+
+/* Function: Nest()
+ * ----------------
+ * StmtBlock: a block's contents moved into a block, if or while inside
+ * it, which keeps its variables first.
+ */
+static bool Nest(std::string *s)
+{
+    static const char *wrappers[] = {
+        "{ ", "if (true) { ", "while (false) { "
+    };
+    std::vector<Token> t = Tokenize(*s);
+    std::vector<int> blocks = Blocks(t);
+
+    if (blocks.empty()) {
+        return false;
+    }
+    // The innermost of a nest more often, so nesting deepens
+    int open = blocks[Random(2) == 0 ? blocks.size() - 1 :
+                      Random(blocks.size())];
+    int close = Matching(t, open);
+    if (close < 0) {
+        return false;
+    }
+    s->insert(t[close].offset, "} ");
+    s->insert(t[open].offset + 1, wrappers[Random(3)]);
+
+    return true;
+}
+
+/* Function: Grow()
+ * ----------------
+ * Expr: an int or bool constant replaced by an expression of it.
+ */
+static bool Grow(std::string *s)
+{
+    std::vector<Token> t = Tokenize(*s);
+    std::vector<int> constants;
+
+    for (int i = 0; i < (int)t.size(); i++) {
+        const std::string &x = t[i].text;
+        if (x == "true" || x == "false" ||
+            (isdigit((unsigned char)x[0]) &&
+             x.find_first_of(".xX") == std::string::npos)) {
+            constants.push_back(i);
+        }
+    }
+    if (constants.empty()) {
+        return false;
+    }
+    const Token &k = t[constants[Random(constants.size())]];
+    std::string e;
+    if (k.text == "true" || k.text == "false") {
+        e = "(" + k.text + (k.text == "true" ? " && " : " || ") + k.text + ")";
+    } else {
+        e = "(" + k.text + (Random(2) == 0 ? " + 0" : " * 1") + ")";
+    }
+    s->replace(k.offset, k.text.size(), e);
+
+    return true;
+}
+
+/* Function: Copy()
+ * ----------------
+ * DeclList: a top-level declaration copied after the last under a new
+ * name; its body is left as it was.
+ */
+static bool Copy(std::string *s)
+{
+    std::vector<Token> t = Tokenize(*s);
+    std::vector<Decl> decls = TopLevel(t);
+
+    if (decls.empty()) {
+        return false;
+    }
+    const Decl &d = decls[Random(decls.size())];
+    std::string name = t[d.name].text;
+    std::string copy = Text(*s, t, d.first, d.last);
+    size_t at = t[d.name].offset - t[d.first].offset;
+    copy.replace(at, name.size(), Fresh((name + "_").c_str()));
+    *s += "\n" + copy + "\n";
+
+    return true;
+}
+
+/* Function: Repeat()
+ * ------------------
+ * StmtList: a simple statement of a block repeated after itself.
+ * Variable declarations, which must come first, are not repeated.
+ */
+static bool Repeat(std::string *s)
+{
+    std::vector<Token> t = Tokenize(*s);
+    std::vector<int> blocks = Blocks(t);
+    std::vector<std::pair<int, int> > stmts;
+
+    for (size_t b = 0; b < blocks.size(); b++) {
+        int close = Matching(t, blocks[b]);
+        int start = blocks[b] + 1, parens = 0;
+        for (int i = start; i < close; i++) {
+            const std::string &x = t[i].text;
+            parens += (x == "(") - (x == ")");
+            if (x == "{" || x == "}") {
+                break; // only up to the first nested block
+            }
+            if (x == ";" && parens == 0) {
+                bool decl = (i - start == 2 && IsIdentifier(t[i - 1].text)) ||
+                            (i - start >= 2 && t[start + 1].text == "[]");
+                if (!decl) {
+                    stmts.push_back(std::make_pair(start, i));
+                }
+                start = i + 1;
+            }
+        }
+    }
+    if (stmts.empty()) {
+        return false;
+    }
+    std::pair<int, int> st = stmts[Random(stmts.size())];
+    s->insert(t[st.second].offset + 1, " " + Text(*s, t, st.first, st.second));
+
+    return true;
+}
+
+// The mutations, weighted so that the shapes whose cost can grow
+// faster than their size (inheritance, interfaces, chains and nesting)
+// are made most; repeated statements only cost more per byte by being
+// dense, and crowd the corpus out when drawn as often
+static const struct {
+    bool (*mutate)(std::string *s);
+    int weight;
+} mutations[] = {
+    { Subclass, 4 }, { Implement, 4 }, { Chain, 4 }, { Nest, 4 },
+    { Grow, 1 }, { Copy, 1 }, { Repeat, 1 }
+};
+static const int NumMutations = sizeof(mutations) / sizeof(mutations[0]);
+
+static bool (*PickMutation())(std::string *s)
+{
+    int total = 0;
+
+    for (int i = 0; i < NumMutations; i++) {
+        total += mutations[i].weight;
+    }
+    int r = Random(total), i = 0;
+    while (r >= mutations[i].weight) {
+        r -= mutations[i].weight;
+        i++;
+    }
+
+    return mutations[i].mutate;
+}
+
+// The number of the line starting with the label in a -ftime-report
+static double Field(const std::string &report, const char *label)
+{
+    std::string key = std::string(" ") + label;
+    size_t at = report.find("\n" + key);
+    double value = 0;
+
+    if (at != std::string::npos) {
+        sscanf(report.c_str() + at + 1 + key.size(), " : %lf", &value);
+    }
+
+    return value;
+}
+
+static std::string ReadFile(const std::string &path)
+{
+    std::string text;
+    FILE *f = fopen(path.c_str(), "r");
+    char buf[65536];
+    size_t n;
+
+    while (f != NULL && (n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        text.append(buf, n);
+    }
+    if (f != NULL) {
+        fclose(f);
+    }
+
+    return text;
+}
+
+static void WriteFile(const std::string &path, const std::string &text)
+{
+    FILE *f = fopen(path.c_str(), "w");
+
+    if (f == NULL || fwrite(text.data(), 1, text.size(), f) != text.size() ||
+        fclose(f) != 0) {
+        Failure("Cannot write %s: %s", path.c_str(), strerror(errno));
+    }
+
+    return;
+}
+
+/* Function: Measure()
+ * -------------------
+ * Compile the input and set its costs per byte: the median compile
+ * time in nanoseconds and the allocations per KB, less those of an
+ * empty compile. A compile cut off by the timeout is charged all of
+ * it.
+ */
+static void Measure(Input *in)
+{
+    std::string input = work + "/input.decaf", report = work + "/report";
+    std::string snapshot = work + "/snapshot.csv";
+    std::string runs = "-fbench=" + std::to_string(GetOption("runs", 3));
+    std::string snapOption = "--mem-snapshot=" + snapshot;
+    const char *dcc = GetStringOption("dcc");
+    double bytes = std::max<size_t>(in->text.size(), 1);
+
+    WriteFile(input, in->text);
+    unlink(snapshot.c_str());
+    pid_t pid = fork();
+    if (pid == 0) {
+        struct rlimit cpu;
+        cpu.rlim_cur = cpu.rlim_max = GetOption("timeout", 20);
+        setrlimit(RLIMIT_CPU, &cpu);
+        int fd = open(input.c_str(), O_RDONLY);
+        int null = open("/dev/null", O_WRONLY);
+        int err = open(report.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(fd, 0);
+        dup2(null, 1);
+        dup2(err, 2);
+        execl(dcc, dcc, "-ftime-report", runs.c_str(), snapOption.c_str(),
+              (char*)NULL);
+        _exit(127);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+        Failure("Cannot run %s: %s", dcc, strerror(errno));
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+        Failure("Cannot run %s", dcc);
+    }
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGXCPU) {
+        in->nsPerByte = GetOption("timeout", 20) * 1e9 / bytes;
+        in->allocsPerKb = 0;
+        return;
+    }
+
+    // TOTAL is to a tenth of a millisecond, too coarse for small
+    // inputs, but the throughput in lines per second has the digits
+    std::string times = ReadFile(report);
+    double lines = Field(times, "input lines");
+    double rate = Field(times, "throughput");
+    double ns = (rate > 0 ? lines / rate : Field(times, "TOTAL")) * 1e9;
+    in->nsPerByte = std::max(ns - fixedNs, 0.0) / bytes;
+    long allocations = 0;
+    std::string csv = ReadFile(snapshot);
+    for (size_t at = csv.find('\n'); at != std::string::npos;
+         at = csv.find('\n', at + 1)) {
+        char section[16];
+        long count;
+        if (sscanf(csv.c_str() + at + 1, "%15[a-z],%*[^,],%ld", section,
+                   &count) == 2 && strcmp(section, "peak") != 0) {
+            allocations += count;
+        }
+    }
+    in->allocsPerKb = std::max(allocations - fixedAllocations, 0.0) * 1024 /
+                      bytes;
+
+    return;
+}
+
+// Measure twice, taking the faster time, so that a slow moment is not
+// taken for a costly input
+static void MeasureAgain(Input *in)
+{
+    Input again = *in;
+
+    Measure(&again);
+    in->nsPerByte = std::min(in->nsPerByte, again.nsPerByte);
+
+    return;
+}
+
+// How far over the thresholds an input is; 1 is at them
+static double Score(const Input &in)
+{
+    return std::max(in.nsPerByte / GetOption("ns-per-byte", 1500),
+                    in.allocsPerKb / GetOption("allocs-per-kb", 1200));
+}
+
+// The score of a population member. Below -fmin-bytes a compile takes
+// too little time to measure per byte, and a tiny input that happened
+// to be timed slow would breed in place of one growing a costly shape
+static double Fitness(const Input &in)
+{
+    return Score(in) * std::min(1.0, (double)in.text.size() /
+                                     GetOption("min-bytes", 512));
+}
+
+static bool ByName(const Input &a, const Input &b)
+{
+    return a.name < b.name;
+}
+
+static std::vector<Input> Seeds(const char *dir)
+{
+    std::vector<Input> seeds;
+    DIR *d = opendir(dir);
+    struct dirent *e;
+
+    while (d != NULL && (e = readdir(d)) != NULL) {
+        std::string name = e->d_name;
+        if (name.size() > 6 &&
+            name.compare(name.size() - 6, 6, ".decaf") == 0) {
+            Input in = { name, ReadFile(std::string(dir) + "/" + name), 0, 0 };
+            seeds.push_back(in);
+        }
+    }
+    if (d != NULL) {
+        closedir(d);
+    }
+    std::sort(seeds.begin(), seeds.end(), ByName);
+
+    return seeds;
+}
+
+// The inputs listed in costs.txt, with their recorded costs
+static std::vector<Input> ReadCosts(const std::string &corpus)
+{
+    std::vector<Input> costs;
+    std::string text = ReadFile(corpus + "/costs.txt");
+    size_t at = 0;
+
+    while (at < text.size()) {
+        size_t end = text.find('\n', at);
+        end = (end == std::string::npos ? text.size() : end);
+        std::string line = text.substr(at, end - at);
+        char name[256];
+        long bytes;
+        Input in;
+        if (line[0] != '#' && sscanf(line.c_str(), "%255s %ld %lf %lf", name,
+                                     &bytes, &in.nsPerByte,
+                                     &in.allocsPerKb) == 4) {
+            in.name = name;
+            in.text = ReadFile(corpus + "/" + in.name);
+            costs.push_back(in);
+        }
+        at = end + 1;
+    }
+
+    return costs;
+}
+
+static void WriteCosts(const std::string &corpus,
+                       const std::vector<Input> &costs)
+{
+    std::string text = "# input bytes ns-per-byte allocs-per-kb\n"
+                       "# written by bench/fuzzcost\n";
+
+    for (size_t i = 0; i < costs.size(); i++) {
+        char line[512];
+        snprintf(line, sizeof(line), "%s %zu %.0f %.0f\n",
+                 costs[i].name.c_str(), costs[i].text.size(),
+                 costs[i].nsPerByte, costs[i].allocsPerKb);
+        text += line;
+    }
+    WriteFile(corpus + "/costs.txt", text);
+
+    return;
+}
+
+/* Function: Replay()
+ * ------------------
+ * Measure the corpus again against costs.txt; returns the exit status.
+ */
+static int Replay(const std::string &corpus)
+{
+    std::vector<Input> costs = ReadCosts(corpus);
+    int tolerance = GetOption("tolerance", 25), failed = 0;
+    int timeTolerance = GetOption("time-tolerance", 100);
+
+    printf("%-24s %7s %12s %12s  %s\n", "input", "bytes", "ns/byte",
+           "allocs/KB", "vs recorded");
+    for (size_t i = 0; i < costs.size(); i++) {
+        Input now = costs[i];
+        Measure(&now);
+        MeasureAgain(&now);
+        double dt = 100 * (now.nsPerByte / costs[i].nsPerByte - 1);
+        double da = costs[i].allocsPerKb > 0 ?
+                    100 * (now.allocsPerKb / costs[i].allocsPerKb - 1) : 0;
+        bool worse = (dt > timeTolerance || da > tolerance);
+        printf("%-24s %7zu %12.0f %12.0f  %+.1f%% time %+.1f%% allocs%s\n",
+               now.name.c_str(), now.text.size(), now.nsPerByte,
+               now.allocsPerKb, dt, da, worse ? "  COSTLIER" : "");
+        failed |= worse;
+        costs[i] = now;
+    }
+    if (GetOption("update", 0) != 0) {
+        WriteCosts(corpus, costs);
+        printf("costs written to %s/costs.txt\n", corpus.c_str());
+        return 0;
+    }
+
+    return failed;
+}
+
+int main(int argc, char *argv[])
+{
+    ParseCommandLine(argc, argv);
+    if (GetStringOption("dcc") == NULL) {
+        SetOption("dcc", "./dcc");
+    }
+    const char *seedDir = GetStringOption("seeds");
+    const char *corpusOption = GetStringOption("corpus");
+    std::string corpus = corpusOption ? corpusOption : "bench/corpus";
+    int iterations = GetOption("iterations", 500);
+    size_t maxBytes = GetOption("max-bytes", 32768);
+    char dir[] = "/tmp/fuzzcost.XXXXXX";
+
+    rng.seed(GetOption("seed", 1));
+    if (mkdtemp(dir) == NULL) {
+        Failure("Cannot make a work directory: %s", strerror(errno));
+    }
+    work = dir;
+    Input empty = { "", "", 0, 0 };
+    Measure(&empty);
+    fixedNs = empty.nsPerByte;
+    fixedAllocations = empty.allocsPerKb / 1024;
+    if (GetOption("replay", 0) != 0) {
+        int status = Replay(corpus);
+        system(("rm -rf " + work).c_str());
+        return status;
+    }
+
+    std::vector<Input> population = Seeds(seedDir ? seedDir : "samples");
+    if (population.empty()) {
+        Failure("No seeds in %s", seedDir ? seedDir : "samples");
+    }
+    for (size_t i = 0; i < population.size(); i++) {
+        Measure(&population[i]);
+    }
+    mkdir(corpus.c_str(), 0755);
+    std::vector<Input> kept = ReadCosts(corpus);
+    double best = 0;
+    for (size_t i = 0; i < kept.size(); i++) {
+        best = std::max(best, Score(kept[i]));
+    }
+
+    for (int n = 0; n < iterations; n++) {
+        // The costlier of two, with one to three mutations each made
+        // up to 32 times over, so a shape grows far enough to show how
+        // its cost scales
+        const Input &a = population[Random(population.size())];
+        const Input &b = population[Random(population.size())];
+        Input child = Fitness(a) >= Fitness(b) ? a : b;
+        for (int m = Random(3); m >= 0; m--) {
+            bool (*mutate)(std::string *s) = PickMutation();
+            for (int k = 1 << Random(6); k > 0 && mutate(&child.text); k--) {
+                continue;
+            }
+        }
+        if (child.text.size() > maxBytes) {
+            continue;
+        }
+        Measure(&child);
+        PrintDebug("fuzzcost", "%zu bytes, %.0f ns/byte, %.0f allocs/KB",
+                   child.text.size(), child.nsPerByte, child.allocsPerKb);
+
+        // Replace the cheapest when the child is costlier
+        size_t worst = 0;
+        for (size_t i = 1; i < population.size(); i++) {
+            if (Fitness(population[i]) < Fitness(population[worst])) {
+                worst = i;
+            }
+        }
+        if (Fitness(child) > Fitness(population[worst])) {
+            population[worst] = child;
+        }
+
+        // Kept when over the thresholds and a tenth costlier than all
+        // kept before, or each would be followed by its near copies
+        bool big = (int)child.text.size() >= GetOption("min-bytes", 512);
+        if (big && Score(child) > std::max(best * 1.1, 1.0)) {
+            MeasureAgain(&child);
+        }
+        if (big && Score(child) > std::max(best * 1.1, 1.0)) {
+            best = Score(child);
+            char name[32];
+            snprintf(name, sizeof(name), "cost%04zu.decaf", kept.size());
+            child.name = name;
+            WriteFile(corpus + "/" + child.name, child.text);
+            kept.push_back(child);
+            WriteCosts(corpus, kept);
+            printf("%s: %zu bytes, %.0f ns/byte, %.0f allocs/KB\n", name,
+                   child.text.size(), child.nsPerByte, child.allocsPerKb);
+        }
+    }
+    system(("rm -rf " + work).c_str());
+
+    return 0;
+}
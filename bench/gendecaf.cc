@@ -0,0 +1,210 @@
+/* File: gendecaf.cc
+ * -----------------
+ * Writes a synthetic, error-free Decaf program on stdout, for measuring
+ * how dcc scales. The shape is set with options, written as for dcc:
+ *
+ *   -fdepth=N      levels in the class hierarchy               (3)
+ *   -ffanout=N     subclasses of each class                    (2)
+ *   -finterfaces=N interfaces the root class implements        (2)
+ *   -fmembers=N    fields, and methods, declared per class     (4)
+ *   -ffunctions=N  global functions                            (20)
+ *   -fstmts=N      statements per block                        (8)
+ *   -fnesting=N    operators in each expression, nested        (3)
+ *   -fidlen=N      identifier length, up to 31                 (8)
+ *
+ * Every class overrides the interface methods, every method calls one
+ * inherited from its parent, and every function constructs an object of
+ * each class and calls through the interfaces, so checking, dispatch
+ * and lookups all scale with the knobs.
+ */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "utility.h"
+
+static int depth, fanout, interfaces, members, functions, stmts, nesting;
+static int idlen;
+
+// A unique identifier of the configured length: prefix, number, padding
+static std::string Name(const char *prefix, int n)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s%d", prefix, n);
+    std::string s = buf;
+    while ((int)s.size() < idlen) {
+        s += 'x';
+    }
+
+    return s;
+}
+
+// An int expression over the given variables with `nesting` operators
+static std::string Expr(const std::vector<std::string> &vars, int seed)
+{
+    static const char *ops[] = {" + ", " - ", " * "};
+    std::string e = vars[seed % vars.size()];
+
+    for (int i = 0; i < nesting; i++) {
+        std::string leaf = (i % 3 == 2) ? std::to_string(i + 1) :
+                           vars[(seed + i + 1) % vars.size()];
+        e = "(" + e + ops[(seed + i) % 3] + leaf + ")";
+    }
+
+    return e;
+}
+
+// `stmts` statements over the variables, with one level of nested blocks
+static void Stmts(const std::vector<std::string> &vars, const std::string &call,
+                  int level, const char *indent)
+{
+    std::string in = std::string(indent) + "  ";
+    const std::string &v0 = vars[0], &v1 = vars[1 % vars.size()];
+
+    for (int i = 0; i < stmts; i++) {
+        int kind = level < 1 ? i % 5 : 0;
+        if (kind == 1) {
+            printf("%sif (%s < %s) {\n", indent, Expr(vars, i).c_str(),
+                   Expr(vars, i + 1).c_str());
+            Stmts(vars, call, level + 1, in.c_str());
+            printf("%s} else {\n", indent);
+            Stmts(vars, call, level + 1, in.c_str());
+            printf("%s}\n", indent);
+        } else if (kind == 2) {
+            printf("%swhile (%s > %s) {\n", indent, v0.c_str(),
+                   Expr(vars, i).c_str());
+            Stmts(vars, call, level + 1, in.c_str());
+            printf("%s}\n", indent);
+        } else if (kind == 3) {
+            printf("%sfor (%s = 0; %s < %s; %s = %s + 1) {\n", indent,
+                   v1.c_str(), v1.c_str(), Expr(vars, i).c_str(),
+                   v1.c_str(), v1.c_str());
+            Stmts(vars, call, level + 1, in.c_str());
+            printf("%s}\n", indent);
+        } else if (kind == 4 && !call.empty()) {
+            printf("%s%s = %s(%s, %s);\n", indent, v0.c_str(), call.c_str(),
+                   Expr(vars, i).c_str(), v1.c_str());
+        } else {
+            printf("%s%s = %s;\n", indent, vars[i % vars.size()].c_str(),
+                   Expr(vars, i).c_str());
+        }
+    }
+
+    return;
+}
+
+// The body of an int function of (a, b): locals, statements, return
+static void Body(const std::string &call)
+{
+    std::vector<std::string> vars;
+    vars.push_back(Name("a", 0));
+    vars.push_back(Name("b", 0));
+    for (int i = 0; i < 3; i++) {
+        vars.push_back(Name("v", i));
+        printf("    int %s;\n", vars.back().c_str());
+    }
+    Stmts(vars, call, 0, "    ");
+    printf("    return %s;\n", vars[2].c_str());
+
+    return;
+}
+
+static void Method(const std::string &name, const std::string &call)
+{
+    printf("  int %s(int %s, int %s) {\n", name.c_str(),
+           Name("a", 0).c_str(), Name("b", 0).c_str());
+    Body(call);
+    printf("  }\n");
+
+    return;
+}
+
+int main(int argc, char *argv[])
+{
+    ParseCommandLine(argc, argv);
+    depth = GetOption("depth", 3);
+    fanout = GetOption("fanout", 2);
+    interfaces = GetOption("interfaces", 2);
+    members = GetOption("members", 4);
+    functions = GetOption("functions", 20);
+    stmts = GetOption("stmts", 8);
+    nesting = GetOption("nesting", 3);
+    idlen = GetOption("idlen", 8);
+    if (depth < 1 || fanout < 1 || members < 1 || stmts < 1 ||
+        idlen > 31) {
+        Failure("depth, fanout, members and stmts must be positive and "
+                "idlen at most 31");
+    }
+
+    for (int i = 0; i < interfaces; i++) {
+        printf("interface %s {\n  int %s(int a, int b);\n}\n\n",
+               Name("I", i).c_str(), Name("im", i).c_str());
+    }
+
+    // Classes in breadth-first order; class c extends parent[c]
+    std::vector<int> parent(1, -1), level(1, 0);
+    for (int c = 0; c < (int)parent.size(); c++) {
+        for (int k = 0; level[c] + 1 < depth && k < fanout; k++) {
+            parent.push_back(c);
+            level.push_back(level[c] + 1);
+        }
+    }
+    for (int c = 0; c < (int)parent.size(); c++) {
+        printf("class %s", Name("C", c).c_str());
+        if (parent[c] >= 0) {
+            printf(" extends %s", Name("C", parent[c]).c_str());
+        }
+        for (int i = 0; i < interfaces; i++) {
+            printf(i == 0 ? " implements %s" : ", %s", Name("I", i).c_str());
+        }
+        printf(" {\n");
+        for (int m = 0; m < members; m++) {
+            printf("  int %s;\n", Name("f", c * members + m).c_str());
+        }
+        // Each method calls the parent's same-numbered method
+        for (int m = 0; m < members; m++) {
+            Method(Name("m", c * members + m), parent[c] < 0 ? "" :
+                   Name("m", parent[c] * members + m));
+        }
+        for (int i = 0; i < interfaces; i++) {
+            Method(Name("im", i), Name("m", c * members));
+        }
+        printf("}\n\n");
+    }
+
+    for (int f = 0; f < functions; f++) {
+        printf("int %s(int %s, int %s) {\n", Name("fn", f).c_str(),
+               Name("a", 0).c_str(), Name("b", 0).c_str());
+        // Objects of each class, called directly and through interfaces
+        std::string obj = Name("o", 0), itf = Name("it", 0);
+        printf("  %s %s;\n", Name("C", 0).c_str(), obj.c_str());
+        if (interfaces > 0) {
+            printf("  %s %s;\n", Name("I", 0).c_str(), itf.c_str());
+        }
+        printf("  {\n");
+        Body(f == 0 ? "" : Name("fn", f - 1));
+        printf("  }\n");
+        for (int c = 0; c < (int)parent.size() && c < 8; c++) {
+            printf("  %s = New(%s);\n", obj.c_str(), Name("C", c).c_str());
+            printf("  %s = %s.%s(%s, %s);\n", Name("a", 0).c_str(),
+                   obj.c_str(), Name("m", 0).c_str(), Name("a", 0).c_str(),
+                   Name("b", 0).c_str());
+            if (interfaces > 0) {
+                printf("  %s = %s;\n", itf.c_str(), obj.c_str());
+                printf("  %s = %s.%s(%s, %s);\n", Name("b", 0).c_str(),
+                       itf.c_str(), Name("im", 0).c_str(),
+                       Name("a", 0).c_str(), Name("b", 0).c_str());
+            }
+        }
+        printf("  return %s;\n}\n\n", Name("a", 0).c_str());
+    }
+
+    if (functions > 0) {
+        printf("void main() {\n  Print(%s(1, 2));\n}\n",
+               Name("fn", functions - 1).c_str());
+    } else {
+        printf("void main() {\n  Print(0);\n}\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+#!/bin/bash
+
+##** bench/run.sh - Phase benchmarks over generated programs **********
+#
+# Usage: bench/run.sh [-u] [runs]
+#
+# Generates each workload below with bench/gendecaf, compiles it `runs`
+# times (default 5) in one dcc process with -fbench, and reports the
+# median time, throughput and peak RSS next to bench/baseline.txt.
+# Workloads more than $BENCH_TOLERANCE percent (default 25) slower than
+# the baseline are marked and make the script fail. With -u the
+# baseline is rewritten from this run instead.
+
+cd "$(dirname "$0")/.."
+
+workloads=(
+    "default        |"
+    "deep-classes   |-fdepth=7 -ffanout=2"
+    "wide-classes   |-fdepth=3 -ffanout=10"
+    "interfaces     |-finterfaces=32"
+    "members        |-fdepth=2 -fmembers=48"
+    "functions      |-ffunctions=300"
+    "long-blocks    |-fstmts=24"
+    "deep-exprs     |-fnesting=24"
+    "long-idents    |-fidlen=31"
+)
+
+update=0
+if [ "$1" == "-u" ]
+then
+    update=1
+    shift
+fi
+runs=${1:-5}
+tolerance=${BENCH_TOLERANCE:-25}
+baseline=bench/baseline.txt
+input=$(mktemp /tmp/bench.XXXXXX.decaf)
+trap 'rm -f $input' EXIT
+
+# Field of the -ftime-report line starting with the given label
+field() {
+    sed -n "s/^ $1 *: *\([0-9.]*\).*/\1/p" <<< "$2"
+}
+
+printf "%-14s %8s %9s %10s %9s  %s\n" \
+       workload lines "median s" "lines/s" "peak KB" "vs baseline"
+failed=0
+results=""
+for w in "${workloads[@]}"
+do
+    name=$(echo ${w%%|*})
+    ./bench/gendecaf ${w#*|} > $input || exit 1
+    report=$(./dcc -fbench=$runs < $input 2>&1 >/dev/null)
+    lines=$(field "input lines" "$report")
+    total=$(field TOTAL "$report")
+    rate=$(field throughput "$report")
+    peak=$(field "peak RSS" "$report")
+    results+="$name $total $rate $peak"$'\n'
+
+    old=$(awk -v n=$name '$1 == n { print $2 }' $baseline 2>/dev/null)
+    if [ -z "$old" ]
+    then
+        change="-"
+    else
+        change=$(awk -v t=$total -v o=$old -v tol=$tolerance 'BEGIN {
+            d = 100 * (t - o) / o
+            printf "%+.1f%% time%s", d, (d > tol ? "  SLOWER" : "") }')
+        case "$change" in *SLOWER) failed=1 ;; esac
+    fi
+    printf "%-14s %8s %9s %10s %9s  %s\n" \
+           $name $lines $total $rate $peak "$change"
+done
+
+if [ $update == 1 ]
+then
+    {
+        echo "# workload median-seconds lines-per-second peak-rss-kb"
+        echo "# written by bench/run.sh -u $runs"
+        echo -n "$results"
+    } > $baseline
+    echo "baseline written to $baseline"
+    exit 0
+fi
+exit $failed
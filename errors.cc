@@ -8,10 +8,13 @@
 #include <sstream>
 #include <stdarg.h>
 #include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
 #include <utility>
 using namespace std;
 
 #include "scanner.h" // for GetLineNumbered
+#include "memstats.h"
 #include "ast_type.h"
 #include "ast_expr.h"
 #include "ast_stmt.h"
@@ -20,13 +23,34 @@ using namespace std;
 
 int ReportError::numErrors = 0;
 multimap<yyltype,string> ReportError::errors;
+string ReportError::output;
 
 void ReportError::UnderlineErrorInLine(const char *line, const yyltype *pos) {
     if (!line) return;
-    cerr << line << endl;
+    output += line;
+    output += '\n';
     for (int i = 1; i <= pos->last_column; i++)
-        cerr << (i >= pos->first_column ? '^' : ' ');
-    cerr << endl;
+        output += (i >= pos->first_column ? '^' : ' ');
+    output += '\n';
+}
+
+/* Diagnostics are formatted into one buffer and written with as few
+ * write calls as possible: cerr is unbuffered, so streaming thousands
+ * of errors through it costs a system call per fragment.
+ */
+void ReportError::FlushOutput() {
+    const char *p = output.data();
+    size_t left = output.size();
+
+    fflush(stdout); // make sure any buffered text has been output
+    while (left > 0) {
+        ssize_t n = write(STDERR_FILENO, p, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        p += n;
+        left -= n;
+    }
+    output.clear();
 }
 
  
@@ -34,24 +58,37 @@ void ReportError::EmitError(yyltype *loc, string msg) {
     numErrors++;
     if (loc) {
 	errors.insert(make_pair(*loc, msg));
+	CountAlloc(ErrorMem, msg.size() + 1);
 	return;
     }
     OutputError(loc, msg);
+    FlushOutput(); // unlocated errors are reported as they happen
 }
 
 void ReportError::OutputError(const yyltype *loc, string msg) {
-    fflush(stdout); // make sure any buffered text has been output
+    char line[32];
     if (loc) {
-        cerr << endl << "*** Error line " << loc->first_line << "." << endl;
+        snprintf(line, sizeof(line), "%d", loc->first_line);
+        output += "\n*** Error line ";
+        output += line;
+        output += ".\n";
         UnderlineErrorInLine(GetLineNumbered(loc->first_line), loc);
     } else
-        cerr << endl << "*** Error." << endl;
-    cerr << "*** " << msg << endl << endl;
+        output += "\n*** Error.\n";
+    output += "*** ";
+    output += msg;
+    output += "\n\n";
 }
 
 void ReportError::PrintErrors() {
     for (multimap<yyltype,string>::iterator iter = errors.begin(); iter != errors.end(); ++iter)
 	OutputError(&iter->first, iter->second);
+    FlushOutput();
+}
+
+void ReportError::DiscardErrors() {
+    numErrors -= errors.size();
+    errors.clear();
 }
 
 void ReportError::Formatted(yyltype *loc, const char *format, ...) {
@@ -97,6 +134,21 @@ void ReportError::DeclConflict(Decl *decl, Decl *prevDecl) {
       << prevDecl->location()->first_line;
     EmitError(decl->location(), s.str());
 }
+
+// The line of an imported declaration is one of its interface's source,
+// so the interface file is named instead
+void ReportError::ImportConflict(Decl *decl, const char *file,
+                                 const char *prevFile) {
+    ostringstream s;
+    s << "Declaration of '" << decl << "' ";
+    if (file == NULL) {
+        s << "here";
+    } else {
+        s << "imported from " << file;
+    }
+    s << " conflicts with declaration imported from " << prevFile;
+    EmitError(file == NULL ? decl->location() : NULL, s.str());
+}
   
 void ReportError::OverrideMismatch(Decl *fnDecl) {
     ostringstream s;
@@ -134,6 +186,10 @@ void ReportError::ThisOutsideClassScope(This *th) {
     EmitError(th->location(), "'this' is only valid within class scope");
 }
 
+void ReportError::DivisionByZero(Expr *divisor) {
+    EmitError(divisor->location(), "Integer division by constant zero");
+}
+
 void ReportError::BracketsOnNonArray(Expr *baseExpr) {
     EmitError(baseExpr->location(), "[] can only be applied to arrays");
 }
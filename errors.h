@@ -65,6 +65,8 @@ class ReportError
   
   // Errors used by semantic analyzer for declarations
   static void DeclConflict(Decl *newDecl, Decl *prevDecl);
+  static void ImportConflict(Decl *newDecl, const char *newFile,
+                             const char *prevFile); // newFile NULL if local
   static void OverrideMismatch(Decl *fnDecl);
   static void InterfaceNotImplemented(Decl *classDecl, Type *intfType);
 
@@ -77,6 +79,7 @@ class ReportError
   static void IncompatibleOperand(Operator *op, Type *rhs); // unary
   static void IncompatibleOperands(Operator *op, Type *lhs, Type *rhs); // binary
   static void ThisOutsideClassScope(This *th);
+  static void DivisionByZero(Expr *divisor);
 
   
  // Errors used by semantic analyzer for array acesss & NewArray
@@ -111,14 +114,20 @@ class ReportError
 
   // Print out all error messages in lexical order
   static void PrintErrors();
+
+  // Forget the errors not yet printed, when a tentative parse of part
+  // of the input is abandoned for a full one
+  static void DiscardErrors();
   
  private:
 
   static void UnderlineErrorInLine(const char *line, const yyltype *pos);
   static void EmitError(yyltype *loc, string msg);
   static void OutputError(const yyltype *loc, string msg);
+  static void FlushOutput();
   static int numErrors;
   static multimap<yyltype,string> errors;
+  static string output; // formatted, not yet written to stderr
   
 };
 
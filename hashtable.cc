@@ -16,7 +16,7 @@ template <class Value> void Hashtable<Value>::Enter(const char *key, Value val,
   Value prev;
   if (overwrite && (prev = Lookup(key)))
     Remove(key, prev);
-  mmap.insert(std::make_pair(strdup(key), val));
+  mmap.insert(std::make_pair(CountedStrdup(HashtableKeyMem, key), val));
 }
 
  
@@ -30,7 +30,7 @@ template <class Value> void Hashtable<Value>::Remove(const char *key, Value val)
   if (mmap.count(key) == 0) // no matches at all
     return;
 
-  typename std::multimap<const char *, Value>::iterator itr;
+  typename HashtableMap<Value>::type::iterator itr;
   itr = mmap.find(key); // start at first occurrence
   while (itr != mmap.upper_bound(key)) {
     if (itr->second == val) { // iterate to find matching pair
@@ -51,11 +51,13 @@ template <class Value> Value Hashtable<Value>::Lookup(const char *key)
 {
   Value found = NULL;
   
+  Count(LookupCalls);
   if (mmap.count(key) > 0) {
-    typename std::multimap<const char *, Value>::iterator cur, last, prev;
+    typename HashtableMap<Value>::type::iterator cur, last, prev;
     cur = mmap.find(key); // start at first occurrence
     last = mmap.upper_bound(key);
     while (cur != last) { // iterate to find last entered
+	Count(LookupProbes);
 	prev = cur; 
 	if (++cur == mmap.upper_bound(key)) { // have to go one too far
 	  found = prev->second; // one before last was it
@@ -35,6 +35,8 @@
 
 #include <map>
 #include <string.h>
+#include "stats.h"
+#include "memstats.h"
 
 struct ltstr {
     bool operator()(const char* s1, const char* s2) const
@@ -44,14 +46,21 @@ struct ltstr {
 
 template <class Value> class Iterator;
 
+// The map under a Hashtable, whose entries are counted for --mem-report
+template <class Value> struct HashtableMap {
+    typedef std::multimap<const char*, Value, ltstr,
+        CountingAllocator<std::pair<const char* const, Value>,
+                          HashtableNodeMem> > type;
+};
+
 template<class Value> class Hashtable {
 
     private:
-        std::multimap<const char*, Value, ltstr> mmap;
+        typename HashtableMap<Value>::type mmap;
 
     public:
         // ctor creates a new empty hashtable
-        Hashtable() {}
+        Hashtable() { CountAlloc(HashtableMem, sizeof(*this)); }
 
         // Returns number of entries currently in table
         int NumEntries() const;
@@ -91,8 +100,8 @@ template<class Value> class Iterator {
     friend class Hashtable<Value>;
 
     private:
-	typename std::multimap<const char*, Value , ltstr>::iterator cur, end;
-	Iterator(std::multimap<const char*, Value, ltstr>& t)
+	typename HashtableMap<Value>::type::iterator cur, end;
+	Iterator(typename HashtableMap<Value>::type& t)
         : cur(t.begin()), end(t.end()) {}
 
     public:
@@ -0,0 +1,381 @@
+/* File: incremental.cc
+ * --------------------
+ * Keeping a parse between runs and reparsing only what an edit
+ * damaged.
+ *
+ * The kept file is a header, an entry per top-level declaration, the
+ * declarations' images at 8-byte boundaries, and the source. An image
+ * holds lines relative to the one its declaration begins on, so one
+ * an edit moved keeps its image, and the file is the same whether a
+ * declaration was parsed or rebuilt.
+ */
+
+#include "incremental.h"
+#include "astcache.h"
+#include "errors.h"
+#include "parser.h"
+#include "stats.h"
+#include "stringpool.h"
+#include "utility.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+
+// Bump whenever the layout of the file changes
+static const int KeptFormat = 1;
+
+struct KeptHeader {
+    char magic[8];   // "DCCKEEP\0"
+    int format;
+    int numDecls;    // KeptDecls after the header
+    int sourceSize;  // bytes of source at the end
+    unsigned hash;   // of the KeptDecls and the source
+};
+
+struct KeptDecl {
+    DeclStart start;
+    int imageSize;
+};
+
+static const char KeptMagic[8] = {'D', 'C', 'C', 'K', 'E', 'E', 'P', '\0'};
+
+// The kept file as mapped by Reparse, which KeepParse copies the
+// images of unchanged declarations from
+static void *mapped = NULL;
+static size_t mappedSize;
+static const KeptDecl *keptDecls;
+static int numKept;
+static std::vector<const char*> keptImages;
+static const char *keptSource;
+static int keptSourceSize;
+
+// For each top-level declaration of the program Reparse built, the
+// kept one it was rebuilt from, or -1 for one it parsed
+static std::vector<int> reused;
+
+static size_t Align(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+// Map what KeepParse wrote; false if there is no such file or it does
+// not hold a well formed parse
+static bool MapKept(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+
+    if (mapped != NULL) {
+        munmap(mapped, mappedSize);
+        mapped = NULL;
+    }
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(KeptHeader)) {
+        close(fd);
+        return false;
+    }
+    mappedSize = st.st_size;
+    mapped = mmap(NULL, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        mapped = NULL;
+        return false;
+    }
+
+    const KeptHeader *h = (const KeptHeader*)mapped;
+    const char *base = (const char*)mapped;
+    if (memcmp(h->magic, KeptMagic, sizeof(KeptMagic)) != 0 ||
+        h->format != KeptFormat || h->numDecls <= 0 ||
+        h->sourceSize < 0 ||
+        Align(sizeof(*h) + (size_t)h->numDecls * sizeof(KeptDecl)) +
+        h->sourceSize > mappedSize) {
+        return false;
+    }
+    keptDecls = (const KeptDecl*)(h + 1);
+    numKept = h->numDecls;
+    keptSourceSize = h->sourceSize;
+    keptSource = base + mappedSize - keptSourceSize;
+
+    // The images fill what is between the entries and the source
+    size_t at = Align(sizeof(*h) + numKept * sizeof(KeptDecl));
+    keptImages.clear();
+    for (int i = 0; i < numKept; i++) {
+        const KeptDecl &d = keptDecls[i];
+        if (d.imageSize <= 0 ||
+            at + d.imageSize > mappedSize - keptSourceSize ||
+            d.start.offset < (i == 0 ? 0 : keptDecls[i - 1].start.offset + 1)
+            || d.start.offset >= keptSourceSize || d.start.line < 1 ||
+            d.start.column < 1) {
+            return false;
+        }
+        keptImages.push_back(base + at);
+        at = Align(at + d.imageSize);
+    }
+    if (at != mappedSize - keptSourceSize) {
+        return false;
+    }
+
+    std::string hashed((const char*)keptDecls, numKept * sizeof(KeptDecl));
+    hashed.append(keptSource, keptSourceSize);
+
+    return HashString(hashed.data(), hashed.size()) == h->hash;
+}
+
+/* Function: EndsInComment()
+ * -------------------------
+ * Follows the scanner's rules for comments and strings over the text:
+ * true if it ends inside a comment, which the scanner reports as it
+ * happens, so the caller must not scan it. Sets blank if the text has
+ * only spaces and comments.
+ */
+static bool EndsInComment(const char *text, int length, bool *blank)
+{
+    *blank = true;
+    for (int i = 0; i < length; i++) {
+        char c = text[i];
+        if (c == '/' && i + 1 < length && text[i + 1] == '/') {
+            while (i < length && text[i] != '\n') {
+                i++;
+            }
+        } else if (c == '/' && i + 1 < length && text[i + 1] == '*') {
+            const char *end = (const char*)memmem(text + i + 2,
+                                                  length - i - 2, "*/", 2);
+            if (end == NULL) {
+                return true;
+            }
+            i = end - text + 1;
+        } else if (c == '"') {
+            *blank = false;
+            for (i++; i < length && text[i] != '"' && text[i] != '\n'; i++) {
+            }
+        } else if (c != ' ' && c != '\t' && c != '\n') {
+            *blank = false;
+        }
+    }
+
+    return false;
+}
+
+/* Function: ParseRegion()
+ * -----------------------
+ * Parse the declarations of source[at.offset, end), which begins at a
+ * declaration or the top of the file, appending them to decls and
+ * where they begin to starts. False, with its errors forgotten, if the
+ * region does not parse by itself.
+ */
+static bool ParseRegion(const std::string &source, const DeclStart &at,
+                        int end, List<Decl*> *decls, List<DeclStart> *starts)
+{
+    const char *text = source.data() + at.offset;
+    bool blank;
+
+    if (EndsInComment(text, end - at.offset, &blank)) {
+        return false;
+    }
+    if (blank) {
+        return true;
+    }
+
+    FILE *in = fmemopen((void*)text, end - at.offset, "r");
+    if (in == NULL) {
+        return false;
+    }
+    InitScannerAt(at.line, at.column, at.offset);
+    InitParser();
+    yyrestart(in);
+    program = NULL;
+    StartPhase(ParsePhase);
+    yyparse();
+    EndPhase(ParsePhase);
+    fclose(in);
+    if (program == NULL || ReportError::NumErrors() > 0) {
+        ReportError::DiscardErrors();
+        program = NULL;
+        return false;
+    }
+
+    List<Node*> parsed;
+    program->GetChildren(&parsed);
+    program = NULL;
+    if (parsed.NumElements() != declStarts.NumElements()) {
+        return false;
+    }
+    for (int i = 0; i < parsed.NumElements(); i++) {
+        decls->Append(dynamic_cast<Decl*>(parsed.Nth(i)));
+        starts->Append(declStarts.Nth(i));
+        reused.push_back(-1);
+    }
+
+    return true;
+}
+
+// Rebuild kept declaration k, which now begins at the given line
+static bool Rebuild(int k, int line, List<Decl*> *decls)
+{
+    Decl *d = LoadDecl(keptImages[k], keptDecls[k].imageSize, line);
+
+    if (d == NULL) {
+        return false;
+    }
+    decls->Append(d);
+    reused.push_back(k);
+
+    return true;
+}
+
+Program *Reparse(const std::string &source)
+{
+    reused.clear();
+    StartPhase(CachePhase);
+    bool found = MapKept(GetStringOption("incremental"));
+    EndPhase(CachePhase);
+    if (!found) {
+        return NULL;
+    }
+
+    // The edit replaced old[first, oldEnd) with source[first, newEnd)
+    const char *old = keptSource;
+    int n = numKept;
+    int first = 0, oldEnd = keptSourceSize, newEnd = source.size();
+    while (first < oldEnd && first < newEnd && old[first] == source[first]) {
+        first++;
+    }
+    while (oldEnd > first && newEnd > first &&
+           old[oldEnd - 1] == source[newEnd - 1]) {
+        oldEnd--;
+        newEnd--;
+    }
+    int lineDelta = std::count(source.begin() + first,
+                               source.begin() + newEnd, '\n') -
+                    std::count(old + first, old + oldEnd, '\n');
+    int sizeDelta = newEnd - oldEnd;
+
+    // Declarations [0, p) end before the edit, and [q, n) begin on a
+    // line after it, so their columns stand; the last one runs to the
+    // end of the file and is always parsed again
+    int p = 0;
+    while (p + 1 < n && keptDecls[p + 1].start.offset <= first) {
+        p++;
+    }
+    int q = p;
+    while (q < n && (keptDecls[q].start.offset <= oldEnd ||
+                     memchr(old + oldEnd, '\n',
+                            keptDecls[q].start.offset - oldEnd) == NULL)) {
+        q++;
+    }
+    DeclStart top = {0, 1, 1};
+    DeclStart regionStart = (p == 0) ? top : keptDecls[p].start;
+    int regionEnd = (q == n) ? source.size() :
+                    keptDecls[q].start.offset + sizeDelta;
+
+    // Rebuilt in source order, so string constants are pooled in the
+    // order a full parse would meet them
+    List<Decl*> *decls = new List<Decl*>;
+    List<DeclStart> starts;
+    bool ok = true;
+    StartPhase(CachePhase);
+    for (int i = 0; ok && i < p; i++) {
+        ok = Rebuild(i, keptDecls[i].start.line, decls);
+        starts.Append(keptDecls[i].start);
+    }
+    EndPhase(CachePhase);
+    ok = ok && ParseRegion(source, regionStart, regionEnd, decls, &starts);
+    StartPhase(CachePhase);
+    for (int i = q; ok && i < n; i++) {
+        DeclStart s = keptDecls[i].start;
+        s.offset += sizeDelta;
+        s.line += lineDelta;
+        ok = Rebuild(i, s.line, decls);
+        starts.Append(s);
+    }
+    EndPhase(CachePhase);
+    if (!ok || decls->NumElements() == 0) {
+        reused.clear();
+        return NULL; // a program with no declarations is left to the parser
+    }
+
+    PrintDebug("incremental", "Kept %d and %d declarations, reparsed %d",
+               p, n - q, decls->NumElements() - p - (n - q));
+    declStarts = starts;
+    SetSavedLines(source.data(), source.size());
+
+    return new Program(decls);
+}
+
+void KeepParse(Program *program, const std::string &source)
+{
+    const char *path = GetStringOption("incremental");
+    List<Node*> decls;
+    std::vector<KeptDecl> entries;
+    std::vector<std::string> images; // of declarations parsed this time
+    KeptHeader h;
+
+    program->GetChildren(&decls);
+    if (decls.NumElements() != declStarts.NumElements()) {
+        return;
+    }
+    for (int i = 0; i < decls.NumElements(); i++) {
+        KeptDecl e;
+        e.start = declStarts.Nth(i);
+        if (i < (int)reused.size() && reused[i] >= 0) {
+            e.imageSize = keptDecls[reused[i]].imageSize;
+        } else {
+            images.push_back(std::string());
+            if (!SaveDecl(dynamic_cast<Decl*>(decls.Nth(i)), e.start.line,
+                          &images.back())) {
+                return;
+            }
+            e.imageSize = images.back().size();
+        }
+        entries.push_back(e);
+    }
+
+    std::string hashed((const char*)&entries[0],
+                       entries.size() * sizeof(KeptDecl));
+    hashed.append(source);
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, KeptMagic, sizeof(KeptMagic));
+    h.format = KeptFormat;
+    h.numDecls = entries.size();
+    h.sourceSize = source.size();
+    h.hash = HashString(hashed.data(), hashed.size());
+
+    // Write and rename, so an interrupted run leaves the last parse
+    std::string temp = std::string(path) + ".tmp";
+    FILE *f = fopen(temp.c_str(), "wb");
+    if (f == NULL) {
+        fprintf(stderr, "*** Cannot write %s: %s\n", temp.c_str(),
+                strerror(errno));
+        return;
+    }
+    static const char padding[8] = {0};
+    size_t at = sizeof(h) + entries.size() * sizeof(KeptDecl);
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(&entries[0], sizeof(KeptDecl), entries.size(), f) ==
+              entries.size();
+    for (size_t i = 0, parsed = 0; ok && i < entries.size(); i++) {
+        const char *image = (i < reused.size() && reused[i] >= 0) ?
+                            keptImages[reused[i]] : images[parsed++].data();
+        ok = fwrite(padding, 1, Align(at) - at, f) == Align(at) - at &&
+             fwrite(image, 1, entries[i].imageSize, f) ==
+             (size_t)entries[i].imageSize;
+        at = Align(at) + entries[i].imageSize;
+    }
+    ok = ok && fwrite(padding, 1, Align(at) - at, f) == Align(at) - at &&
+         fwrite(source.data(), 1, source.size(), f) == source.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(temp.c_str(), path) != 0) {
+        fprintf(stderr, "*** Cannot write %s: %s\n", path, strerror(errno));
+        unlink(temp.c_str());
+    }
+
+    return;
+}
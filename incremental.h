@@ -0,0 +1,44 @@
+/* File: incremental.h
+ * -------------------
+ * Incremental reparsing, for an editor that checks a large file after
+ * each small edit. With --incremental=file, dcc keeps in that file the
+ * source it last parsed, where each top-level declaration of it began,
+ * and an image of each declaration in the AST cache's records
+ * (astcache.h).
+ *
+ * The next run compares its source with the kept one. Declarations
+ * that end before the first changed byte are rebuilt from their
+ * records as they were, and those that begin on a line after the last
+ * changed byte are rebuilt with their lines moved by the number the
+ * edit added or removed. Only the text between, from the start of the
+ * first damaged declaration to the start of the first intact one, is
+ * scanned and parsed again. Should that part not parse cleanly on its
+ * own, the whole source is parsed instead, so the program is always
+ * the one a full parse would build.
+ */
+
+#ifndef _H_incremental
+#define _H_incremental
+
+#include <string>
+
+class Program;
+
+
+/* Function: Reparse()
+ * -------------------
+ * The program for the source, reusing what it can of the one last
+ * kept, or NULL if nothing was kept or the edited part did not parse
+ * by itself; the caller then parses the whole source.
+ */
+Program *Reparse(const std::string &source);
+
+
+/* Function: KeepParse()
+ * ---------------------
+ * Keep a program just parsed or reparsed without errors from the
+ * source for the next run's Reparse.
+ */
+void KeepParse(Program *program, const std::string &source);
+
+#endif
@@ -2,10 +2,12 @@
  * ------------
  * Simple list class for storing a linear collection of elements. It
  * supports operations similar in name to the CS107 DArray -- nth, insert,
- * append, remove, etc.  This class is nothing more than a very thin
- * cover of a STL deque, with some added range-checking. Given not everyone
- * is familiar with the C++ templates, this class provides a more familiar
- * interface.
+ * append, remove, etc.  The elements are kept contiguously, the first
+ * few of them inside the List itself, so the short lists most of the AST
+ * is made of (formals, actuals, small blocks) never touch the heap; longer
+ * ones grow into a heap array like a STL vector. Indexing is range-checked,
+ * and given not everyone is familiar with the C++ templates, this class
+ * provides a more familiar interface.
  *
  * It can handle elements of any type, the typename for a List includes the
  * element type in angle brackets, e.g.  to store elements of type double,
@@ -17,76 +19,215 @@
  *   int Sum(List<int> *list)
  *   {
  *       int sum = 0;
- *       for (int i = 0; i < list->NumElements(); i++) {
- *          int val = list->Nth(i);
+ *       for (int val : *list) {
  *          sum += val;
  *       }
  *       return sum;
  *    }
+ *
+ * Nth(i) gives the element at an index as well. Pointers to elements,
+ * and the iterators begin() and end(), stay good until the list grows or
+ * shrinks.
  */
 
 #ifndef _H_list
 #define _H_list
 
-#include <deque>
+#include <new>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <type_traits>
 #include <algorithm>
 #include "utility.h"  // for Assert()
+#include "memstats.h" // for CountingAllocator
 
 class Node;
 
 template<class Element> class List {
 
     private:
-        std::deque<Element> elems;
+        // How many elements fit in the list itself
+        static const int InlineElements = 4;
+        typedef CountingAllocator<Element, ListMem> Allocator;
+
+        Element *elems;         // inlineElems, or a heap array when larger
+        int numElems, capacity;
+        typename std::aligned_storage<sizeof(Element),
+                 std::alignment_of<Element>::value>::type
+            inlineElems[InlineElements];
+
+        Element *InlineStorage()
+        { return reinterpret_cast<Element*>(inlineElems); }
+        bool OnHeap() const
+        { return elems != reinterpret_cast<const Element*>(inlineElems); }
+
+        // Destroys the elements from index on
+        void Truncate(int index)
+        { for (int i = index; i < numElems; i++) {
+                elems[i].~Element();
+            }
+            numElems = index; }
+
+        // Makes room for at least n more elements, doubling the capacity
+        void Grow(int n)
+        { if (numElems + n > capacity)
+            Reserve(std::max(numElems + n, 2 * capacity)); }
+
+        // Takes over the elements of lst, leaving it empty
+        void Steal(List<Element> &lst)
+        { if (lst.OnHeap()) {
+                elems = lst.elems;
+                numElems = lst.numElems;
+                capacity = lst.capacity;
+                lst.elems = lst.InlineStorage();
+                lst.numElems = 0;
+                lst.capacity = InlineElements;
+            } else {
+                std::uninitialized_copy(std::make_move_iterator(lst.begin()),
+                                        std::make_move_iterator(lst.end()),
+                                        elems);
+                numElems = lst.numElems;
+                lst.Truncate(0);
+            } }
 
     public:
+        typedef Element *iterator;
+        typedef const Element *const_iterator;
+
         // Create a new empty list
-        List() {}
+        List() : elems(InlineStorage()), numElems(0),
+                 capacity(InlineElements) {}
         // Copy a list
-        List(const List<Element> &lst) : elems(lst.elems) {}
-
-        // Clear the list
-        void Clear() { elems.clear(); }
+        List(const List<Element> &lst) : elems(InlineStorage()), numElems(0),
+                                         capacity(InlineElements)
+        { AppendAll(lst); }
+        // Move a list, leaving the other one empty
+        List(List<Element> &&lst) : elems(InlineStorage()), numElems(0),
+                                    capacity(InlineElements)
+        { Steal(lst); }
+
+        ~List()
+        { Truncate(0);
+            if (OnHeap()) {
+                Allocator().deallocate(elems, capacity);
+            } }
+
+        List<Element> &operator=(const List<Element> &lst)
+        { if (this != &lst) {
+                Truncate(0);
+                AppendAll(lst);
+            }
+            return *this; }
+        List<Element> &operator=(List<Element> &&lst)
+        { if (this != &lst) {
+                Truncate(0);
+                if (OnHeap()) {
+                    Allocator().deallocate(elems, capacity);
+                }
+                elems = InlineStorage();
+                capacity = InlineElements;
+                Steal(lst);
+            }
+            return *this; }
+
+        // Clear the list, keeping its storage
+        void Clear() { Truncate(0); }
 
         // Returns count of elements currently in list
         int NumElements() const
-        { return elems.size(); }
+        { return numElems; }
+
+        // Makes room for n elements in all, so appending up to that many
+        // allocates nothing
+        void Reserve(int n)
+        { if (n <= capacity) {
+                return;
+            }
+            Element *grown = Allocator().allocate(n);
+            std::uninitialized_copy(std::make_move_iterator(begin()),
+                                    std::make_move_iterator(end()), grown);
+            int count = numElems;
+            Truncate(0);
+            if (OnHeap()) {
+                Allocator().deallocate(elems, capacity);
+            }
+            elems = grown;
+            numElems = count;
+            capacity = n; }
 
         // Returns element at index in list. Indexing is 0-based.
         // Raises an assert if index is out of range.
-        Element Nth(int index) const
-        { Assert(index >= 0 && index < NumElements());
+        const Element &Nth(int index) const
+        { Assert(index >= 0 && index < numElems);
             return elems[index]; }
 
         // Inserts element at index, shuffling over others
         // Raises assert if index out of range
         void InsertAt(const Element &elem, int index)
-        { Assert(index >= 0 && index <= NumElements());
-            elems.insert(elems.begin() + index, elem); }
+        { Assert(index >= 0 && index <= numElems);
+            Element copy(elem);  // elem may be in the list
+            Grow(1);
+            if (index == numElems) {
+                new (elems + numElems) Element(std::move(copy));
+            } else {
+                new (elems + numElems) Element(std::move(elems[numElems - 1]));
+                std::move_backward(elems + index, elems + numElems - 1,
+                                   elems + numElems);
+                elems[index] = std::move(copy);
+            }
+            numElems++; }
 
         // Adds element to list end
         void Append(const Element &elem)
-        { elems.push_back(elem); }
+        { if (numElems < capacity) {
+                new (elems + numElems) Element(elem);
+            } else {
+                Element copy(elem);  // elem may be in the list
+                Grow(1);
+                new (elems + numElems) Element(std::move(copy));
+            }
+            numElems++; }
+        void Append(Element &&elem)
+        { if (numElems == capacity) {
+                Element moved(std::move(elem));
+                Grow(1);
+                new (elems + numElems) Element(std::move(moved));
+            } else {
+                new (elems + numElems) Element(std::move(elem));
+            }
+            numElems++; }
 
         // Adds all elements to list end
         void AppendAll(const List<Element> &lst)
-        { for (int i = 0; i < lst.NumElements(); i++)
-            Append(lst.Nth(i)); }
+        { int n = lst.numElems;  // lst may be this list
+            Grow(n);
+            std::uninitialized_copy(lst.elems, lst.elems + n,
+                                    elems + numElems);
+            numElems += n; }
 
         // Removes element at index, shuffling down others
         // Raises assert if index out of range
         void RemoveAt(int index)
-        { Assert(index >= 0 && index < NumElements());
-            elems.erase(elems.begin() + index); }
+        { Assert(index >= 0 && index < numElems);
+            std::move(elems + index + 1, end(), elems + index);
+            Truncate(numElems - 1); }
 
         // Removes all elements of a specific value
         void Remove(const Element &elem)
-        { elems.erase(std::remove(elems.begin(), elems.end(), elem), elems.end()); }
+        { Element value(elem);  // elem may be in the list
+            Truncate(std::remove(begin(), end(), value) - begin()); }
 
         // Sort and remove repeated elements
         void Unique()
-        { std::sort(elems.begin(), elems.end());
-            elems.erase(std::unique(elems.begin(), elems.end()), elems.end()); }
+        { std::sort(begin(), end());
+            Truncate(std::unique(begin(), end()) - begin()); }
+
+        // The elements in order, for range-for and the STL algorithms
+        iterator begin() { return elems; }
+        iterator end() { return elems + numElems; }
+        const_iterator begin() const { return elems; }
+        const_iterator end() const { return elems + numElems; }
 
         // These are some specific methods useful for lists of ast nodes
         // They will only work on lists of elements that respond to the
@@ -94,10 +235,9 @@ template<class Element> class List {
         // you can still have Lists of ints, chars*, as long as you
         // don't try to SetParentAll on that list.
         void set_parent_all(Node *p)
-        { for (int i = 0; i < NumElements(); i++)
-            Nth(i)->set_parent(p); }
+        { for (Element elem : *this)
+            elem->set_parent(p); }
 
 };
 
 #endif
-
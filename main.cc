@@ -1,33 +1,250 @@
 /* File: main.cc
  * -------------
- * This file defines the main() routine for the program and not much else.
- * You should not need to modify this file.
+ * The compiler driver. main() reads the command line and sets up the
+ * statistics, tracing and cross-reference output, then compiles the
+ * input once, or -fbench=N times over. Compile() takes one run through
+ * the phases: the program comes from the AST cache, an --incremental
+ * reparse, or a fresh parse. Imported interfaces are declared and the
+ * program checked; if it has no errors, its interface and
+ * cross-reference index are written and it is laid out and optimized.
+ * Errors are printed at the end. ReadSource() reads the whole input for
+ * the cache and incremental modes to key on, and the reports are
+ * printed once every run is over.
  */
  
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include "utility.h"
 #include "errors.h"
 #include "parser.h"
+#include "stats.h"
+#include "memstats.h"
+#include "trace.h"
+#include "astcache.h"
+#include "incremental.h"
+#include "xref.h"
+#include <string>
+#include <algorithm>
 
 
 
+/* Function: ReadSource()
+ * ----------------------
+ * The whole of the input, which the AST cache is keyed by.
+ */
+static std::string ReadSource(void)
+{
+    std::string source;
+    char buf[65536];
+    size_t n;
+
+    while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0) {
+        source.append(buf, n);
+    }
+
+    return source;
+}
+
+
+/* Function: Parse()
+ * -----------------
+ * Parse a complete program from the scanner's input into the global
+ * program, which stays NULL if there is none.
+ */
+static void Parse(void)
+{
+    TraceSpan span(TraceParse, "Parse");
+    StartPhase(ParsePhase);
+    yyparse();
+    EndPhase(ParsePhase);
+
+    return;
+}
+
+
+/* Function: ImportInterfaces()
+ * ----------------------------
+ * Declare the interfaces named by --import-interface=file[,file...] in
+ * the program about to be checked.
+ */
+static void ImportInterfaces(void)
+{
+    const char *files = GetStringOption("import-interface");
+    if (files == NULL) {
+        return;
+    }
+
+    char *list = strdup(files);
+    for (char *f = strtok(list, ","); f != NULL; f = strtok(NULL, ",")) {
+        program->Import(LoadInterface(f), f);
+    }
+    free(list);
+
+    return;
+}
+
+
+/* Function: Compile()
+ * -------------------
+ * InitScanner() is used to set up the scanner.
+ * InitParser() is used to set up the parser. The call to yyparse() will
+ * attempt to parse a complete program from the input, which is then
+ * checked and, if it has no errors, laid out and optimized. Under
+ * -ftime-report each of these phases is timed, and with --trace each
+ * is a span.
+ *
+ * With --ast-cache or --incremental the input has been read into
+ * source. A program cached for it is loaded instead of parsing, or
+ * else one is rebuilt from the parse --incremental kept, reparsing
+ * only what was edited. Failing both the source is parsed, and a new
+ * parse without errors is kept and, if it compiles without errors,
+ * saved to the cache. Interfaces are imported before checking and
+ * exported after, along with the cross-reference index.
+ */
+static void Compile(const std::string *source)
+{
+    const char *cacheDir = GetStringOption("ast-cache");
+    const char *kept = GetStringOption("incremental");
+    std::string image;
+
+    InitScanner();
+    InitParser();
+    program = NULL;
+    if (cacheDir != NULL) {
+        TraceSpan span(TraceParse, "LoadCache");
+        StartPhase(CachePhase);
+        program = LoadCachedProgram(*source);
+        EndPhase(CachePhase);
+    }
+    bool loaded = (program != NULL);
+    if (program == NULL && kept != NULL) {
+        TraceSpan span(TraceParse, "Reparse");
+        program = Reparse(*source);
+        if (program == NULL) {
+            InitScanner(); // it may have scanned part of the source
+            InitParser();
+        }
+    }
+    if (program == NULL && source == NULL) {
+        Parse();
+    } else if (program == NULL) {
+        FILE *in = fmemopen((void*)source->data(), source->size(), "r");
+        if (in == NULL) {
+            Failure("Cannot read the input from memory");
+        }
+        yyrestart(in);
+        Parse();
+        fclose(in);
+    }
+    if (source != NULL && !loaded && program != NULL &&
+        ReportError::NumErrors() == 0) {
+        TraceSpan span(TraceParse, "SaveCache");
+        StartPhase(CachePhase);
+        if (cacheDir != NULL) {
+            SaveProgram(program, *source, &image);
+        }
+        if (kept != NULL) {
+            KeepParse(program, *source);
+        }
+        EndPhase(CachePhase);
+    }
+
+    // if no errors, advance to next phase
+    if (program != NULL && ReportError::NumErrors() == 0) {
+        TraceSpan span(TraceCheck, "Check");
+        StartPhase(CheckPhase);
+        ImportInterfaces();
+        program->Check();
+        EndPhase(CheckPhase);
+    }
+    const char *exported = GetStringOption("export-interface");
+    if (exported != NULL && program != NULL &&
+        ReportError::NumErrors() == 0 && !SaveInterface(program, exported)) {
+        Failure("Cannot export the interface to %s", exported);
+    }
+    if (program != NULL && ReportError::NumErrors() == 0) {
+        WriteXref();
+    }
+    if (program != NULL && ReportError::NumErrors() == 0) {
+        {
+            TraceSpan span(TraceLayout, "Layout");
+            StartPhase(LayoutPhase);
+            program->Layout();
+            EndPhase(LayoutPhase);
+        }
+        TraceSpan span(TraceOptimize, "Optimize");
+        StartPhase(OptimizePhase);
+        program->Optimize();
+        EndPhase(OptimizePhase);
+    }
+    if (!image.empty() && ReportError::NumErrors() == 0) {
+        TraceSpan span(TraceParse, "WriteCache");
+        StartPhase(CachePhase);
+        WriteCachedProgram(image, *source);
+        EndPhase(CachePhase);
+    }
+
+    TraceSpan span(TraceErrors, "PrintErrors");
+    StartPhase(ErrorPhase);
+    ReportError::PrintErrors();
+    EndPhase(ErrorPhase);
+
+    return;
+}
+
+
 /* Function: main()
  * ----------------
  * Entry point to the entire program.  We parse the command line and turn
  * on any debugging flags requested by the user when invoking the program.
- * InitScanner() is used to set up the scanner.
- * InitParser() is used to set up the parser. The call to yyparse() will
- * attempt to parse a complete program from the input. 
+ * With -fbench=N the input, which must then be a file, is compiled N
+ * times over, -ftime-report gives the median of each phase and
+ * --mem-report what each run allocated. With --ast-cache or
+ * --incremental the input is read once and may come from a pipe.
  */
 int main(int argc, char *argv[])
 {
     ParseCommandLine(argc, argv);
-  
-    InitScanner();
-    InitParser();
-    yyparse();
-    ReportError::PrintErrors();
+    InitMemStats();
+    InitStats();
+    InitTrace();
+    InitXref();
+
+    std::string source;
+    bool cached = (GetStringOption("ast-cache") != NULL ||
+                   GetStringOption("incremental") != NULL);
+    if (cached) {
+        source = ReadSource();
+    }
+
+    int runs = GetOption("bench", 1), run;
+    for (run = 0; run < runs; run++) {
+        if (run > 0 && !cached) {
+            if (fseek(stdin, 0, SEEK_SET) != 0) {
+                Failure("-fbench needs its input redirected from a file");
+            }
+            yyrestart(stdin);
+        }
+        Compile(cached ? &source : NULL);
+        int lines = 0;
+        if (cached) {
+            lines = std::count(source.begin(), source.end(), '\n');
+        } else {
+            while (GetLineNumbered(lines + 1) != NULL) {
+                lines++;
+            }
+        }
+        EndRun(lines);
+        if (ReportError::NumErrors() > 0) {
+            run++;
+            break; // only error-free runs are worth repeating
+        }
+    }
+
+    PrintStats();
+    PrintMemStats(run);
+    WriteTrace();
     return (ReportError::NumErrors() == 0? 0 : -1);
 }
 
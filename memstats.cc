@@ -0,0 +1,213 @@
+/* File: memstats.cc
+ * -----------------
+ * Allocation counts for --mem-report and --mem-snapshot.
+ */
+
+#include "memstats.h"
+#include "ast.h"
+#include "stats.h"
+#include "utility.h"
+#include <errno.h>
+#include <stdio.h>
+#include <cxxabi.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+bool memStatsOn = false;
+std::atomic<long> memCounts[NumMemKinds], memBytes[NumMemKinds],
+                  memFreed[NumMemKinds];
+
+static const char *kindNames[NumMemKinds] = {
+    "Hashtable", "Hashtable node", "Hashtable key", "List storage",
+    "name", "location", "saved line", "error string"
+};
+
+// Each node allocated while counting and not yet freed, and the size
+// of it; what nodes were freed is known only in bulk
+static std::unordered_map<void*, size_t> *liveNodes = NULL;
+static std::mutex nodesLock;
+static long freedNodes = 0, freedBytes = 0;
+
+struct MemRow {
+    std::string name;
+    long count, bytes, live;
+};
+
+void InitMemStats(void)
+{
+    memStatsOn = (GetOption("mem-report", 0) != 0 ||
+                  GetStringOption("mem-snapshot") != NULL);
+    if (memStatsOn) {
+        liveNodes = new std::unordered_map<void*, size_t>;
+    }
+
+    return;
+}
+
+void *NodeAlloc(size_t size)
+{
+    void *p = ::operator new(size);
+
+    if (memStatsOn) {
+        std::lock_guard<std::mutex> hold(nodesLock);
+        (*liveNodes)[p] = size;
+    }
+
+    return p;
+}
+
+void NodeFree(void *p)
+{
+    if (memStatsOn && p != NULL) {
+        std::lock_guard<std::mutex> hold(nodesLock);
+        std::unordered_map<void*, size_t>::iterator it = liveNodes->find(p);
+        if (it != liveNodes->end()) {
+            freedNodes++;
+            freedBytes += it->second;
+            liveNodes->erase(it);
+        }
+    }
+    ::operator delete(p);
+
+    return;
+}
+
+// The class of a node as written in the source, e.g. FieldAccess
+static std::string ClassName(Node *n)
+{
+    const char *mangled = typeid(*n).name();
+    int status;
+    char *name = abi::__cxa_demangle(mangled, NULL, NULL, &status);
+    std::string s = (status == 0 ? name : mangled);
+
+    free(name);
+    return s;
+}
+
+// The live nodes by class, in order of name, with those freed after
+static std::vector<MemRow> NodeRows(int runs)
+{
+    std::map<std::string, MemRow> byClass;
+    std::vector<MemRow> rows;
+
+    for (std::unordered_map<void*, size_t>::iterator it = liveNodes->begin();
+         it != liveNodes->end(); ++it) {
+        std::string name = ClassName((Node*)it->first);
+        MemRow &r = byClass[name];
+        r.name = name;
+        r.count++;
+        r.bytes += it->second;
+        r.live += it->second;
+    }
+    for (std::map<std::string, MemRow>::iterator it = byClass.begin();
+         it != byClass.end(); ++it) {
+        rows.push_back(it->second);
+    }
+    if (freedNodes > 0) {
+        MemRow r = { "(freed)", freedNodes, freedBytes, 0 };
+        rows.push_back(r);
+    }
+    for (size_t i = 0; i < rows.size(); i++) {
+        rows[i].count /= runs;
+        rows[i].bytes /= runs;
+        rows[i].live /= runs;
+    }
+
+    return rows;
+}
+
+static bool MoreBytes(const MemRow &a, const MemRow &b)
+{
+    return a.bytes > b.bytes || (a.bytes == b.bytes && a.name < b.name);
+}
+
+// One table of the report, largest first, and its total
+static void PrintRows(const char *title, std::vector<MemRow> rows)
+{
+    long count = 0, bytes = 0, live = 0;
+
+    std::sort(rows.begin(), rows.end(), MoreBytes);
+    fprintf(stderr, "\n%-28s %12s %14s %14s\n", title, "allocations",
+            "bytes", "live bytes");
+    for (size_t i = 0; i < rows.size(); i++) {
+        fprintf(stderr, " %-26s: %12ld %14ld %14ld\n", rows[i].name.c_str(),
+                rows[i].count, rows[i].bytes, rows[i].live);
+        count += rows[i].count;
+        bytes += rows[i].bytes;
+        live += rows[i].live;
+    }
+    fprintf(stderr, " %-26s: %12ld %14ld %14ld\n", "TOTAL", count, bytes,
+            live);
+
+    return;
+}
+
+static void WriteSnapshot(const char *path, const std::vector<MemRow> &nodes,
+                          const std::vector<MemRow> &support)
+{
+    FILE *f = fopen(path, "w");
+
+    if (f == NULL) {
+        Failure("Cannot write memory snapshot %s: %s", path, strerror(errno));
+    }
+    fprintf(f, "section,name,count,bytes,live\n");
+    for (size_t i = 0; i < nodes.size(); i++) {
+        fprintf(f, "node,%s,%ld,%ld,%ld\n", nodes[i].name.c_str(),
+                nodes[i].count, nodes[i].bytes, nodes[i].live);
+    }
+    for (size_t i = 0; i < support.size(); i++) {
+        fprintf(f, "support,%s,%ld,%ld,%ld\n", support[i].name.c_str(),
+                support[i].count, support[i].bytes, support[i].live);
+    }
+    for (int p = 0; p < NumPhases; p++) {
+        if (PhasePeakKb((Phase)p) > 0) {
+            fprintf(f, "peak,%s,,%ld,\n", PhaseName((Phase)p),
+                    PhasePeakKb((Phase)p) * 1024);
+        }
+    }
+    if (fclose(f) != 0) {
+        Failure("Cannot write memory snapshot %s: %s", path, strerror(errno));
+    }
+
+    return;
+}
+
+void PrintMemStats(int runs)
+{
+    const char *snapshot = GetStringOption("mem-snapshot");
+
+    if (!memStatsOn || runs < 1) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> hold(nodesLock);
+    std::vector<MemRow> nodes = NodeRows(runs), support;
+    for (int k = 0; k < NumMemKinds; k++) {
+        MemRow r = { kindNames[k], memCounts[k] / runs, memBytes[k] / runs,
+                     (memBytes[k] - memFreed[k]) / runs };
+        support.push_back(r);
+    }
+
+    if (GetOption("mem-report", 0) != 0) {
+        const char *per = (runs == 1 ? "" : " (per run)");
+        PrintRows((std::string("AST nodes") + per).c_str(), nodes);
+        PrintRows((std::string("Support structures") + per).c_str(), support);
+        fprintf(stderr, "\nPeak RSS by phase\n");
+        for (int p = 0; p < NumPhases; p++) {
+            if (PhasePeakKb((Phase)p) > 0) {
+                fprintf(stderr, " %-26s: %12ld KB\n", PhaseName((Phase)p),
+                        PhasePeakKb((Phase)p));
+            }
+        }
+    }
+    if (snapshot != NULL) {
+        WriteSnapshot(snapshot, nodes, support);
+    }
+
+    return;
+}
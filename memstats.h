@@ -0,0 +1,134 @@
+/* File: memstats.h
+ * ----------------
+ * Where the compiler's memory goes. With --mem-report every AST node is
+ * counted under its class, along with the structures around the tree:
+ * Hashtables and their entries, the heap arrays of Lists, names, the
+ * saved source lines and the error messages. The allocations, the
+ * bytes they took and the bytes still live at the end, and the peak
+ * resident set size of each phase, are printed on stderr at exit.
+ * --mem-snapshot=file.csv writes the same numbers as CSV, one line per
+ * row and in a fixed order, so two versions can be compared with diff.
+ * Nothing is counted unless one of these was asked for.
+ */
+
+#ifndef _H_memstats
+#define _H_memstats
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+
+enum MemKind {
+    HashtableMem,     // Hashtable objects
+    HashtableNodeMem, // entries of their maps
+    HashtableKeyMem,  // keys Enter copies
+    ListMem,          // heap arrays of Lists too long to fit inline
+    NameMem,          // names of identifiers and types
+    LocationMem,      // locations of nodes
+    SavedLineMem,     // source lines kept for error messages
+    ErrorMem,         // messages of errors waiting to be printed
+    NumMemKinds
+};
+
+extern bool memStatsOn;
+extern std::atomic<long> memCounts[NumMemKinds], memBytes[NumMemKinds],
+                         memFreed[NumMemKinds];
+
+
+/* Function: InitMemStats()
+ * ------------------------
+ * Turn on counting if --mem-report or --mem-snapshot was given. Call
+ * after ParseCommandLine and before InitStats.
+ */
+void InitMemStats(void);
+
+
+/* Function: CountAlloc()
+ * Usage: CountAlloc(LocationMem, sizeof(yyltype));
+ * ------------------------------------------------
+ * Count an allocation of the given size. Safe to call from any thread.
+ */
+inline void CountAlloc(MemKind k, size_t bytes)
+{
+    if (memStatsOn) {
+        memCounts[k].fetch_add(1, std::memory_order_relaxed);
+        memBytes[k].fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    return;
+}
+
+
+/* Function: CountFree()
+ * ----------------------
+ * Count bytes counted by CountAlloc as freed again.
+ */
+inline void CountFree(MemKind k, size_t bytes)
+{
+    if (memStatsOn) {
+        memFreed[k].fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    return;
+}
+
+
+/* Function: CountedStrdup()
+ * Usage: name_ = CountedStrdup(NameMem, n);
+ * -----------------------------------------
+ * strdup, counting the copy.
+ */
+inline char *CountedStrdup(MemKind k, const char *s)
+{
+    CountAlloc(k, strlen(s) + 1);
+
+    return strdup(s);
+}
+
+
+/* Functions: NodeAlloc(), NodeFree()
+ * ----------------------------------
+ * Node's operator new and delete. While counting, each live node is
+ * remembered with its size, and is charged to its class when the
+ * report is printed.
+ */
+void *NodeAlloc(size_t size);
+void NodeFree(void *p);
+
+
+/* Class: CountingAllocator
+ * Usage: CountingAllocator<Element, ListMem>().allocate(n);
+ * ---------------------------------------------------------
+ * The standard allocator, counting what it allocates under the kind.
+ */
+template<class T, MemKind K> struct CountingAllocator {
+    typedef T value_type;
+    template<class U> struct rebind { typedef CountingAllocator<U, K> other; };
+
+    CountingAllocator() {}
+    template<class U> CountingAllocator(const CountingAllocator<U, K> &) {}
+
+    T *allocate(size_t n)
+    { CountAlloc(K, n * sizeof(T));
+        return std::allocator<T>().allocate(n); }
+    void deallocate(T *p, size_t n)
+    { CountFree(K, n * sizeof(T));
+        std::allocator<T>().deallocate(p, n); }
+
+    template<class U> bool operator==(const CountingAllocator<U, K> &) const
+    { return true; }
+    template<class U> bool operator!=(const CountingAllocator<U, K> &) const
+    { return false; }
+};
+
+
+/* Function: PrintMemStats()
+ * -------------------------
+ * Print the report on stderr and write the snapshot, whichever was
+ * asked for. Counts are averaged over the given number of runs.
+ */
+void PrintMemStats(int runs);
+
+#endif
@@ -12,6 +12,7 @@
   
 #include "scanner.h"            // for MaxIdentLen
 #include "list.h"       	// because we use all these types
+#include "stringpool.h"         // for string constants
 #include "ast.h"		// in the union, we need their declarations
 #include "ast_type.h"
 #include "ast_decl.h"
@@ -34,5 +35,13 @@
 
 int yyparse();              // Defined in the generated y.tab.c file
 void InitParser();          // Defined in parser.y
+extern Program *program;    // Set by yyparse when the whole input parses
+
+// Where a top-level declaration begins, found from the tokens as they
+// are scanned: the first token outside braces after a ';' or '}'
+struct DeclStart {
+    int offset, line, column;
+};
+extern List<DeclStart> declStarts; // of the last yyparse, in order
 
 #endif
@@ -8,9 +8,17 @@
 #include "scanner.h" // for yylex
 #include "parser.h"
 #include "errors.h"
+#include "stats.h"
+#include "trace.h"
 
 void yyerror(const char *msg); // standard error-handling routine
 
+Program *program = NULL;
+List<DeclStart> declStarts;
+
+static int TimedLex(void);
+#define yylex TimedLex  // charge the scanner's time to scanning
+
 %}
 
  
@@ -20,7 +28,7 @@ void yyerror(const char *msg); // standard error-handling routine
 %union {
     int integerConstant;
     bool boolConstant;
-    char *stringConstant;
+    PooledString *stringConstant;
     double doubleConstant;
     char identifier[MaxIdentLen+1]; // +1 for terminating null
     Decl *decl;
@@ -99,10 +107,8 @@ void yyerror(const char *msg); // standard error-handling routine
  */
 Program   :    DeclList            { 
                                       @1; 
-                                      Node *program = new Program($1);
-                                      // if no errors, advance to next phase
-                                      if (ReportError::NumErrors() == 0) 
-                                          program->Check();
+                                      // main runs the later phases
+                                      program = new Program($1);
                                     }
           ;
 
@@ -187,14 +193,19 @@ FnDecl    :    FnHeader StmtBlock   { ($$=$1)->set_body($2); }
           ;
 
 StmtBlock :    '{' VarDecls StmtList '}' 
-                                    { $$ = new StmtBlock($2, $3); }
+                                    { std::reverse($3->begin(), $3->end());
+                                      $$ = new StmtBlock($2, $3); }
           ;
 
 VarDecls  :    VarDecls VarDecl     { ($$=$1)->Append($2); }
           |    /* empty */          { $$ = new List<VarDecl*>; }
           ;
 
-StmtList  :    Stmt StmtList        { $$ = $2; $$->InsertAt($1, 0); }
+/* StmtList is right-recursive so that VarDecls can end where it
+ * starts, which builds it back to front: statements are appended as they
+ * are reduced, last first, and StmtBlock puts them in order once.
+ */
+StmtList  :    Stmt StmtList        { ($$=$2)->Append($1); }
           |    /* empty */          { $$ = new List<Stmt*>; }
           ;
 
@@ -286,6 +297,9 @@ OptElse   :    T_Else Stmt          { $$ = $2; }
 %%
 
 
+static int braceDepth;   // for NoteDeclStart
+static bool atDeclStart;
+
 /* Function: InitParser
  * --------------------
  * This function will be called before any calls to yyparse().  It is designed
@@ -303,4 +317,44 @@ void InitParser()
 {
    PrintDebug("parser", "Initializing parser");
    yydebug = false;
+   declStarts.Clear();
+   braceDepth = 0;
+   atDeclStart = true;
+}
+
+/* Function: NoteDeclStart
+ * -----------------------
+ * Follows the nesting of braces to record in declStarts where each
+ * top-level declaration begins, for incremental reparsing.
+ */
+static void NoteDeclStart(int token)
+{
+   if (token == 0) {
+      return;
+   }
+   if (atDeclStart) {
+      DeclStart start = {GetTokenOffset(), yylloc.first_line,
+                         yylloc.first_column};
+      declStarts.Append(start);
+      atDeclStart = false;
+   }
+   if (token == '{') {
+      braceDepth++;
+   } else if (token == '}' && braceDepth > 0) {
+      atDeclStart = (--braceDepth == 0);
+   } else if (token == ';') {
+      atDeclStart = (braceDepth == 0);
+   }
+}
+
+#undef yylex
+
+static int TimedLex(void)
+{
+   TraceSpan span(TraceScan, "yylex");
+   StartPhase(ScanPhase);
+   int token = yylex();
+   EndPhase(ScanPhase);
+   NoteDeclStart(token);
+   return token;
 }
@@ -0,0 +1,205 @@
+/* File: profile.cc
+ * ----------------
+ * Reading and writing execution profiles.
+ */
+
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+
+struct BranchCount {
+    long taken, notTaken;
+};
+
+static bool loaded = false;
+static std::map<std::string, long> calls;
+static std::map<std::string, BranchCount> branches;
+static std::map<std::string, List<ReceiverCount> > receivers;
+static std::string output;
+
+// Parse one record; false if it is malformed
+static bool ParseRecord(char *line)
+{
+    char *kind = strtok(line, " \t\r\n");
+    char *key = strtok(NULL, " \t\r\n");
+    char *field, *end;
+
+    if (kind == NULL || kind[0] == '#') {
+        return true;
+    }
+    if (key == NULL) {
+        return false;
+    }
+    if (strcmp(kind, "calls") == 0) {
+        if ((field = strtok(NULL, " \t\r\n")) == NULL) {
+            return false;
+        }
+        calls[key] = strtol(field, &end, 10);
+        return *end == '\0';
+    }
+    if (strcmp(kind, "branch") == 0) {
+        BranchCount b;
+        char *taken = strtok(NULL, " \t\r\n");
+        char *notTaken = strtok(NULL, " \t\r\n");
+        if (taken == NULL || notTaken == NULL) {
+            return false;
+        }
+        b.taken = strtol(taken, &end, 10);
+        if (*end != '\0') {
+            return false;
+        }
+        b.notTaken = strtol(notTaken, &end, 10);
+        branches[key] = b;
+        return *end == '\0';
+    }
+    if (strcmp(kind, "receiver") == 0) {
+        // No class=count fields is an explicit zero: no receivers
+        List<ReceiverCount> &counts = receivers[key];
+        counts.Clear();
+        while ((field = strtok(NULL, " \t\r\n")) != NULL) {
+            char *eq = strchr(field, '=');
+            if (eq == NULL || eq == field) {
+                return false;
+            }
+            ReceiverCount rc;
+            rc.className = strndup(field, eq - field);
+            rc.count = strtol(eq + 1, &end, 10);
+            if (*end != '\0') {
+                return false;
+            }
+            counts.Append(rc);
+        }
+        return true;
+    }
+
+    return false;
+}
+
+bool ReadProfile(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[4096];
+    int lineno = 0;
+
+    if (f == NULL) {
+        fprintf(stderr, "*** Cannot read profile %s\n", path);
+        return false;
+    }
+    calls.clear();
+    branches.clear();
+    receivers.clear();
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+        if (!ParseRecord(line)) {
+            fprintf(stderr, "*** Malformed profile record at %s:%d\n",
+                    path, lineno);
+            fclose(f);
+            return false;
+        }
+    }
+    fclose(f);
+    loaded = true;
+
+    return true;
+}
+
+bool HaveProfile(void)
+{
+    return loaded;
+}
+
+bool ProfiledCalls(const char *fn, long *count)
+{
+    std::map<std::string, long>::iterator it = calls.find(fn);
+
+    if (it == calls.end()) {
+        return false;
+    }
+    *count = it->second;
+
+    return true;
+}
+
+bool ProfiledBranch(const char *site, long *taken, long *notTaken)
+{
+    std::map<std::string, BranchCount>::iterator it = branches.find(site);
+
+    if (it == branches.end()) {
+        return false;
+    }
+    *taken = it->second.taken;
+    *notTaken = it->second.notTaken;
+
+    return true;
+}
+
+bool ProfiledReceivers(const char *site, List<ReceiverCount> *counts)
+{
+    std::map<std::string, List<ReceiverCount> >::iterator it =
+        receivers.find(site);
+
+    if (it == receivers.end()) {
+        return false;
+    }
+    counts->AppendAll(it->second);
+
+    return true;
+}
+
+void RecordCalls(const char *fn, long count)
+{
+    char buf[32];
+
+    snprintf(buf, sizeof(buf), " %ld\n", count);
+    output += "calls ";
+    output += fn;
+    output += buf;
+
+    return;
+}
+
+void RecordBranch(const char *site, long taken, long notTaken)
+{
+    char buf[64];
+
+    snprintf(buf, sizeof(buf), " %ld %ld\n", taken, notTaken);
+    output += "branch ";
+    output += site;
+    output += buf;
+
+    return;
+}
+
+void RecordReceivers(const char *site, List<ReceiverCount> *counts)
+{
+    char buf[32];
+
+    output += "receiver ";
+    output += site;
+    for (const ReceiverCount &c : *counts) {
+        snprintf(buf, sizeof(buf), "=%ld", c.count);
+        output += " ";
+        output += c.className;
+        output += buf;
+    }
+    output += "\n";
+
+    return;
+}
+
+bool WriteProfile(const char *path)
+{
+    FILE *f = fopen(path, "w");
+
+    if (f == NULL) {
+        fprintf(stderr, "*** Cannot write profile %s\n", path);
+        return false;
+    }
+    fputs("# dcc profile: calls, branch and receiver records\n", f);
+    fwrite(output.data(), 1, output.size(), f);
+
+    return fclose(f) == 0;
+}
@@ -0,0 +1,74 @@
+/* File: profile.h
+ * ---------------
+ * Execution profiles for profile-guided optimization. A profile is a
+ * text file with one record per line:
+ *
+ *   calls    <function> <count>
+ *   calls    <site> <count>
+ *   branch   <site> <taken> <not-taken>
+ *   receiver <site> <class>=<count> ...
+ *
+ * A calls record is the calls made to a function, or those made at a
+ * direct call site; a dynamic call site's are in its receiver record.
+ * Functions are named Class.method or function. A site is the function
+ * name, the line of the test or call relative to the line declaring
+ * the function, and which site of its kind on that line it is, as in
+ * Stack.Push+3#0. Edits elsewhere in the file leave these keys alone.
+ * A receiver record with no classes counts zero calls, as for a call
+ * no class can answer. Blank lines and lines starting with # are
+ * ignored.
+ */
+
+#ifndef _H_profile
+#define _H_profile
+
+#include "list.h"
+
+struct ReceiverCount {
+    const char *className;
+    long count;
+};
+
+
+/* Function: ReadProfile()
+ * Usage: if (!ReadProfile(path)) ...
+ * ---------------------------------
+ * Load the profile in the named file, replacing any loaded before.
+ * Returns false, after printing why, if it cannot be read or parsed.
+ */
+bool ReadProfile(const char *path);
+
+
+/* Function: HaveProfile()
+ * -----------------------
+ * Whether a profile has been loaded.
+ */
+bool HaveProfile(void);
+
+
+/* Functions: ProfiledCalls(), ProfiledBranch(), ProfiledReceivers()
+ * -----------------------------------------------------------------
+ * Look up a record of the loaded profile; false if it has none.
+ */
+bool ProfiledCalls(const char *fn, long *count);
+bool ProfiledBranch(const char *site, long *taken, long *notTaken);
+bool ProfiledReceivers(const char *site, List<ReceiverCount> *counts);
+
+
+/* Functions: RecordCalls(), RecordBranch(), RecordReceivers()
+ * ------------------------------------------------------------
+ * Add a record to the profile being written, in the order recorded.
+ */
+void RecordCalls(const char *fn, long count);
+void RecordBranch(const char *site, long taken, long notTaken);
+void RecordReceivers(const char *site, List<ReceiverCount> *counts);
+
+
+/* Function: WriteProfile()
+ * ------------------------
+ * Write the recorded profile to the named file. Returns false, after
+ * printing why, if it cannot be written.
+ */
+bool WriteProfile(const char *path);
+
+#endif
@@ -21,5 +21,8 @@ void yyrestart(FILE *fp); // ditto
 
 void InitScanner();                 // Defined in scanner.l user subroutines
 const char *GetLineNumbered(int n); // ditto
+void InitScannerAt(int line, int column, int offset); // ditto
+int GetTokenOffset();               // ditto
+void SetSavedLines(const char *text, int length); // ditto
  
 #endif
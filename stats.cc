@@ -0,0 +1,216 @@
+/* File: stats.cc
+ * --------------
+ * Phase timing and internal counters for -ftime-report and -fbench.
+ */
+
+#include "stats.h"
+#include "memstats.h"
+#include "utility.h"
+#include <stdio.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <vector>
+
+bool statsOn = false;
+std::atomic<long> counters[NumCounters];
+
+static const char *phaseNames[NumPhases] = {
+    "scanning", "parsing", "AST cache", "checking", "layout",
+    "optimization", "error printing"
+};
+static const char *counterNames[NumCounters] = {
+    "Hashtable::Lookup calls", "Hashtable::Lookup probes",
+    "GetVar scope hops", "GetFn scope hops", "dynamic_casts in lookups",
+    "Check() calls", "DoCheck() runs"
+};
+
+static double elapsed[NumPhases];
+static Phase running[NumPhases + 1]; // stack of started phases
+static int depth = 0;
+static double since, runStart;
+static bool phasesOn = false; // for timing or the per-phase peaks
+static long phasePeakKb[NumPhases];
+
+// Per finished run: each phase, then the rest, then the total
+static std::vector<double> runTimes[NumPhases + 2];
+static int inputLines = 0;
+static long peakKb = 0;
+
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double Median(std::vector<double> v)
+{
+    std::sort(v.begin(), v.end());
+    int n = v.size();
+
+    return n == 0 ? 0 : (n % 2 == 1 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2);
+}
+
+// The peak resident set size since the last ResetPeak, or failing
+// that since the start
+static long PeakKb(void)
+{
+    FILE *f = fopen("/proc/self/status", "r");
+    char line[256];
+    long kb = -1;
+
+    while (f != NULL && fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "VmHWM: %ld", &kb) == 1) {
+            break;
+        }
+    }
+    if (f != NULL) {
+        fclose(f);
+    }
+    if (kb < 0) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        kb = usage.ru_maxrss;
+    }
+
+    return kb;
+}
+
+// Where Linux allows it, start PeakKb over from the current size
+static void ResetPeak(void)
+{
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+
+    if (f != NULL) {
+        fputs("5", f);
+        fclose(f);
+    }
+
+    return;
+}
+
+void InitStats(void)
+{
+    statsOn = GetOption("time-report", 0) != 0 || GetOption("bench", 1) > 1;
+    phasesOn = statsOn || memStatsOn;
+    runStart = Now();
+
+    return;
+}
+
+void StartPhase(Phase p)
+{
+    if (!phasesOn) {
+        return;
+    }
+
+    double now = Now();
+    if (depth > 0) {
+        elapsed[running[depth - 1]] += now - since;
+    } else if (memStatsOn) {
+        ResetPeak(); // only outermost phases, as the scanner's are many
+    }
+    Assert(depth < NumPhases + 1);
+    running[depth++] = p;
+    since = now;
+
+    return;
+}
+
+void EndPhase(Phase p)
+{
+    if (!phasesOn) {
+        return;
+    }
+
+    double now = Now();
+    Assert(depth > 0 && running[depth - 1] == p);
+    elapsed[p] += now - since;
+    depth--;
+    since = now;
+    if (depth == 0 && memStatsOn) {
+        phasePeakKb[p] = std::max(phasePeakKb[p], PeakKb());
+    }
+
+    return;
+}
+
+void EndRun(int lines)
+{
+    if (!statsOn) {
+        return;
+    }
+
+    double total = Now() - runStart, other = total;
+    for (int i = 0; i < NumPhases; i++) {
+        runTimes[i].push_back(elapsed[i]);
+        other -= elapsed[i];
+        elapsed[i] = 0;
+    }
+    runTimes[NumPhases].push_back(other);
+    runTimes[NumPhases + 1].push_back(total);
+    if (runTimes[0].size() == 1) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        peakKb = usage.ru_maxrss;
+        inputLines = lines;
+    }
+    runStart = Now();
+
+    return;
+}
+
+const char *PhaseName(Phase p)
+{
+    return phaseNames[p];
+}
+
+long PhasePeakKb(Phase p)
+{
+    return phasePeakKb[p];
+}
+
+void PrintStats(void)
+{
+    if (!statsOn || runTimes[0].empty()) {
+        return;
+    }
+
+    int runs = runTimes[0].size();
+    double total = Median(runTimes[NumPhases + 1]);
+    if (runs == 1) {
+        fprintf(stderr, "\nExecution times (seconds)\n");
+    } else {
+        fprintf(stderr, "\nExecution times (seconds, median of %d runs)\n",
+                runs);
+    }
+    for (int i = 0; i <= NumPhases; i++) {
+        double t = Median(runTimes[i]);
+        fprintf(stderr, " %-26s: %8.4f (%3.0f%%)\n",
+                i < NumPhases ? phaseNames[i] : "other",
+                t, total > 0 ? 100 * t / total : 0.0);
+    }
+    fprintf(stderr, " %-26s: %8.4f\n", "TOTAL", total);
+    fprintf(stderr, " %-26s: %8d\n", "input lines", inputLines);
+    fprintf(stderr, " %-26s: %8.0f lines/s\n", "throughput",
+            total > 0 ? inputLines / total : 0.0);
+    fprintf(stderr, " %-26s: %8ld KB\n", "peak RSS", peakKb);
+
+    fprintf(stderr, runs == 1 ? "\nCounters\n" : "\nCounters (per run)\n");
+    for (int i = 0; i < NumCounters; i++) {
+        long n = counters[i] / runs;
+        fprintf(stderr, " %-26s: %10ld", counterNames[i], n);
+        if (i == LookupProbes && counters[LookupCalls] > 0) {
+            fprintf(stderr, " (%.2f per call)",
+                    (double)counters[i] / counters[LookupCalls]);
+        } else if (i == DoCheckRuns && counters[CheckCalls] > 0) {
+            fprintf(stderr, " (%.0f%% of calls)",
+                    100.0 * counters[i] / counters[CheckCalls]);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    return;
+}
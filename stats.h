@@ -0,0 +1,93 @@
+/* File: stats.h
+ * -------------
+ * Phase timing and counters of hot internal operations, reported on
+ * stderr at exit under -ftime-report or -fbench. Nothing is timed or
+ * counted unless the report was asked for.
+ */
+
+#ifndef _H_stats
+#define _H_stats
+
+#include <atomic>
+
+enum Phase {
+    ScanPhase, ParsePhase, CachePhase, CheckPhase, LayoutPhase,
+    OptimizePhase, ErrorPhase, NumPhases
+};
+
+enum Counter {
+    LookupCalls,    // Hashtable::Lookup
+    LookupProbes,   // entries Lookup walked to find the last entered
+    VarHops,        // scopes GetVar visited
+    FnHops,         // scopes GetFn visited
+    LookupCasts,    // dynamic_casts narrowing what a lookup found
+    CheckCalls,     // Node::Check
+    DoCheckRuns,    // Node::DoCheck, i.e. Check on an unchecked node
+    NumCounters
+};
+
+extern bool statsOn;
+extern std::atomic<long> counters[NumCounters];
+
+
+/* Function: InitStats()
+ * ---------------------
+ * Turn on timing and counting if -ftime-report or -fbench was given,
+ * and start the clock for the first run. Call after ParseCommandLine.
+ */
+void InitStats(void);
+
+
+/* Function: EndRun()
+ * ------------------
+ * Close a run of the compiler over an input of the given number of
+ * lines, and start the clock for the next.
+ */
+void EndRun(int lines);
+
+
+/* Functions: StartPhase(), EndPhase()
+ * Usage: StartPhase(CheckPhase); program->Check(); EndPhase(CheckPhase);
+ * ----------------------------------------------------------------------
+ * Charge the time between the two calls to the phase. Phases nest:
+ * while the scanner runs inside the parser, its time is the scanner's
+ * alone. Call only from the main thread.
+ */
+void StartPhase(Phase p);
+void EndPhase(Phase p);
+
+
+/* Function: Count()
+ * Usage: Count(LookupProbes, n);
+ * ------------------------------
+ * Add to a counter. Safe to call from any thread.
+ */
+inline void Count(Counter c, long n = 1)
+{
+    if (statsOn) {
+        counters[c].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    return;
+}
+
+
+/* Functions: PhaseName(), PhasePeakKb()
+ * --------------------------------------
+ * The phase's name in reports, and under --mem-report the largest
+ * resident set size seen while it ran outside any other phase, in KB;
+ * 0 if it never did.
+ */
+const char *PhaseName(Phase p);
+long PhasePeakKb(Phase p);
+
+
+/* Function: PrintStats()
+ * ----------------------
+ * Print on stderr the time of each phase, the throughput in input lines
+ * per second and the peak resident set size of the first run, and the
+ * counters. For several runs, times are medians and counters averages.
+ */
+void PrintStats(void);
+
+#endif
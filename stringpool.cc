@@ -0,0 +1,58 @@
+/* File: stringpool.cc
+ * -------------------
+ * Implementation of the string constant pool.
+ */
+
+#include "stringpool.h"
+#include <stdlib.h>
+#include <string>
+#include "hashtable.h"
+#include "list.h"
+
+static Hashtable<PooledString*> pooled;
+static List<PooledString*> pool;
+
+unsigned HashString(const char *str, int len)
+{
+    unsigned h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)str[i]) * 16777619u;
+    }
+
+    return h;
+}
+
+PooledString *InternString(const char *str, int len)
+{
+    std::string key(str, len);
+    PooledString *s = pooled.Lookup(key.c_str());
+
+    if (s == NULL) {
+        char *chars = (char*)malloc(len + 1);
+        if (chars == NULL) {
+            Failure("Out of memory interning a string");
+        }
+        memcpy(chars, str, len);
+        chars[len] = '\0';
+
+        s = new PooledString;
+        s->chars = chars;
+        s->length = len;
+        s->hash = HashString(str, len);
+        s->index = pool.NumElements();
+        pool.Append(s);
+        pooled.Enter(s->chars, s);
+    }
+
+    return s;
+}
+
+int NumPooledStrings(void)
+{
+    return pool.NumElements();
+}
+
+PooledString *NthPooledString(int n)
+{
+    return pool.Nth(n);
+}
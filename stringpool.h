@@ -0,0 +1,62 @@
+/* File: stringpool.h
+ * ------------------
+ * The string constant pool. Every string literal the scanner sees is
+ * interned here exactly once, so identical literals share one read-only
+ * copy and the pool doubles as the table of string data the program
+ * will carry. Each entry caches its length and hash, which is the same
+ * header the run-time string representation carries, so equality can
+ * usually be decided without looking at the characters.
+ */
+
+#ifndef _H_stringpool
+#define _H_stringpool
+
+#include <string.h>
+
+struct PooledString {
+    const char *chars; // without quotes, null terminated
+    int length;
+    unsigned hash;
+    int index;         // position in the pool, in order of first use
+};
+
+
+/* Function: InternString()
+ * Usage: PooledString *s = InternString(yytext + 1, yyleng - 2);
+ * -------------------------------------------------------------
+ * Returns the pool entry for the len bytes at str, adding it if this is
+ * the first occurrence. The caller's buffer is copied, so it may be
+ * reused. Entries are never freed.
+ */
+PooledString *InternString(const char *str, int len);
+
+
+/* Function: HashString()
+ * ----------------------
+ * The hash cached in every pooled and run-time string (32-bit FNV-1a).
+ */
+unsigned HashString(const char *str, int len);
+
+
+/* Function: NumPooledStrings(), NthPooledString()
+ * -----------------------------------------------
+ * Walk the pool in index order, e.g. to emit the string data.
+ */
+int NumPooledStrings(void);
+PooledString *NthPooledString(int n);
+
+
+/* Function: StringsEqual()
+ * ------------------------
+ * String == as the run-time performs it: interned strings are equal
+ * exactly when they are the same entry, and otherwise a differing
+ * length or hash settles the answer before any byte is compared.
+ */
+inline bool StringsEqual(const PooledString *a, const PooledString *b)
+{
+    return (a == b ||
+            (a->length == b->length && a->hash == b->hash &&
+             memcmp(a->chars, b->chars, a->length) == 0));
+}
+
+#endif
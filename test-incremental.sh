@@ -0,0 +1,101 @@
+#!/bin/bash
+
+##** test-incremental.sh - Differential test of --incremental *********
+#
+# Usage: test-incremental.sh [edits] [seed]
+#
+# For each sample, applies `edits` (default 40) random edits one after
+# another and compiles every version twice: with --incremental keeping
+# its parse from the version before, and from scratch. The output and
+# the kept parse, which holds the tree as AST records, must come out
+# byte for byte the same. An edit that leaves a syntax error is undone
+# after it is compared, as an editor's user would fix it, so that most
+# versions parse and reuse what was kept. Set DCC to test another build.
+
+cd "$(dirname "$0")"
+
+dcc=${DCC:-./dcc}
+edits=${1:-40}
+RANDOM=${2:-1}
+work=$(mktemp -d /tmp/incremental.XXXXXX)
+trap 'rm -rf $work' EXIT
+
+snippets=(
+    "\n" " " "\t" "x" "1" ";" "{" "}" "(" ")" "/*" "*/" "//" "\""
+    "\nint inserted;\n" "\nvoid Inserted() { Print(\"in\"); }\n"
+    "\nclass Inserted { int f; }\n" "/* comment\n spanning lines */"
+    "// to the end of the line\n" "\n\n\n"
+)
+
+# Replace `length` bytes at `offset` of the file with the string
+edit() {
+    local file=$1 offset=$2 length=$3 text=$4
+    {
+        head -c $offset $file
+        printf "$text"
+        tail -c +$((offset + length + 1)) $file
+    } > $work/edited
+    mv $work/edited $file
+}
+
+# Apply one random edit to the file, at any byte or at the start of a
+# line: insert a snippet, delete a few bytes, or copy a few lines from
+# elsewhere
+mutate() {
+    local file=$1
+    local size=$(wc -c < $file)
+    local lines=$(wc -l < $file)
+    local offset=$((RANDOM * 32768 + RANDOM))
+    offset=$((offset % (size + 1)))
+    if [ $((RANDOM % 2)) == 0 ]
+    then
+        offset=$(head -n $((RANDOM % (lines + 1))) $file | wc -c)
+    fi
+    case $((RANDOM % 4)) in
+        0|1)
+            edit $file $offset 0 "${snippets[RANDOM % ${#snippets[@]}]}"
+            ;;
+        2)
+            edit $file $offset $((RANDOM % 8 + 1)) ""
+            ;;
+        3)
+            local from=$((RANDOM % (lines + 1) + 1))
+            sed -n "${from},$((from + RANDOM % 3))p" $file > $work/copied
+            edit $file $offset 0 "$(sed 's/[%\\]/&&/g' $work/copied)\n"
+            ;;
+    esac
+}
+
+failed=0
+versions=0
+for x in samples/*.decaf
+do
+    rm -f $work/kept
+    cp $x $work/source.decaf
+    $dcc --incremental=$work/kept < $work/source.decaf &> /dev/null
+    for ((i = 0; i < edits; i++))
+    do
+        cp $work/source.decaf $work/previous.decaf
+        mutate $work/source.decaf
+        $dcc --incremental=$work/kept < $work/source.decaf &> $work/out
+        rm -f $work/fresh
+        $dcc --incremental=$work/fresh < $work/source.decaf &> $work/expected
+        versions=$((versions + 1))
+        if ! cmp -s $work/out $work/expected ||
+           ([ -e $work/fresh ] && ! cmp -s $work/kept $work/fresh)
+        then
+            echo -e "\e[31m${x} after $((i + 1)) edits\e[0m"
+            diff $work/out $work/expected | head -20
+            cp $work/source.decaf ${x/.decaf/.failed}
+            failed=1
+            break
+        fi
+        if [ ! -e $work/fresh ]
+        then
+            cp $work/previous.decaf $work/source.decaf
+        fi
+    done
+done
+
+echo "$versions versions compared"
+exit $failed
@@ -0,0 +1,151 @@
+/* File: trace.cc
+ * --------------
+ * Recording trace spans and writing them as Chrome trace-event JSON.
+ */
+
+#include "trace.h"
+#include "utility.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+unsigned traceMask = 0;
+
+static const char *categoryNames[NumTraceCategories] = {
+    "scan", "parse", "check", "layout", "optimize", "errors"
+};
+
+struct TraceEvent {
+    TraceCategory category;
+    const char *name, *detail;
+    double start, duration; // microseconds since InitTrace
+    int thread;
+};
+
+static std::vector<TraceEvent> events;
+static std::mutex eventsLock;
+static double origin;
+static std::atomic<int> numThreads(0);
+static __thread int threadId = -1;
+
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3 - origin;
+}
+
+void InitTrace(void)
+{
+    const char *cats = GetStringOption("trace-categories");
+
+    if (GetStringOption("trace") == NULL) {
+        return;
+    }
+    if (cats == NULL) {
+        traceMask = ~0u & ~(unsigned)TraceScan;
+    } else {
+        char *list = strdup(cats);
+        for (char *c = strtok(list, ","); c != NULL; c = strtok(NULL, ",")) {
+            int i = 0;
+            while (i < NumTraceCategories && strcmp(c, categoryNames[i])) {
+                i++;
+            }
+            if (i == NumTraceCategories) {
+                Failure("Unknown trace category \"%s\"", c);
+            }
+            traceMask |= 1u << i;
+        }
+        free(list);
+    }
+    origin = Now();
+
+    return;
+}
+
+void TraceSpan::Begin(void)
+{
+    start_ = Now();
+
+    return;
+}
+
+void TraceSpan::End(void)
+{
+    TraceEvent e;
+
+    if (threadId < 0) {
+        threadId = numThreads++;
+    }
+    e.category = category_;
+    e.name = name_;
+    e.detail = detail_;
+    e.start = start_;
+    e.duration = Now() - start_;
+    e.thread = threadId;
+
+    std::lock_guard<std::mutex> hold(eventsLock);
+    events.push_back(e);
+
+    return;
+}
+
+// Print s as a JSON string
+static void WriteString(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', f);
+        }
+        if ((unsigned char)*s < ' ') {
+            fprintf(f, "\\u%04x", *s);
+        } else {
+            fputc(*s, f);
+        }
+    }
+    fputc('"', f);
+
+    return;
+}
+
+void WriteTrace(void)
+{
+    const char *path = GetStringOption("trace");
+    FILE *f;
+
+    if (path == NULL) {
+        return;
+    }
+    if ((f = fopen(path, "w")) == NULL) {
+        fprintf(stderr, "*** Cannot write trace %s\n", path);
+        return;
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < events.size(); i++) {
+        TraceEvent *e = &events[i];
+        int cat = 0;
+        while ((1 << cat) != e->category) {
+            cat++;
+        }
+        fprintf(f, "{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,"
+                "\"dur\":%.3f,\"cat\":\"%s\",\"name\":", e->thread,
+                e->start, e->duration, categoryNames[cat]);
+        WriteString(f, e->name);
+        if (e->detail != NULL) {
+            fprintf(f, ",\"args\":{\"detail\":");
+            WriteString(f, e->detail);
+            fprintf(f, "}");
+        }
+        fprintf(f, "}%s\n", i + 1 < events.size() ? "," : "");
+    }
+    fprintf(f, "],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(f);
+
+    return;
+}
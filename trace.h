@@ -0,0 +1,98 @@
+/* File: trace.h
+ * -------------
+ * Trace spans for finding where the compiler spends its time. With
+ * --trace=file.json every span recorded is written, at exit, as Chrome
+ * trace-event JSON, which chrome://tracing or Perfetto can load.
+ *
+ * Spans belong to categories; --trace-categories=check,optimize picks
+ * which are recorded. The default is all of them but scan, which has a
+ * span per token. Whether a category is on is a test of one bit, so
+ * spans can stay in hot paths; building with -DNO_TRACE compiles them
+ * out altogether. Use PrintDebug for messages, and spans for timing.
+ */
+
+#ifndef _H_trace
+#define _H_trace
+
+#include <stddef.h>
+
+enum TraceCategory {
+    TraceScan = 1 << 0,     // each token
+    TraceParse = 1 << 1,    // the whole parse
+    TraceCheck = 1 << 2,    // each top-level declaration
+    TraceLayout = 1 << 3,   // class layout and call classification
+    TraceOptimize = 1 << 4, // call graph, each function, inlining
+    TraceErrors = 1 << 5,   // printing the errors
+    NumTraceCategories = 6
+};
+
+extern unsigned traceMask;
+
+
+/* Function: TraceOn()
+ * -------------------
+ * Whether spans of the category are being recorded.
+ */
+inline bool TraceOn(TraceCategory c)
+{
+#ifdef NO_TRACE
+    return false;
+#else
+    return (traceMask & c) != 0;
+#endif
+}
+
+
+/* Class: TraceSpan
+ * Usage: TraceSpan span(TraceCheck, "Check", decl->id()->name());
+ * ---------------------------------------------------------------
+ * Records the time from its construction to the end of the enclosing
+ * scope, under the given name and an optional detail, such as the
+ * declaration being checked. Both strings must outlive the span. Spans
+ * may be opened on any thread.
+ */
+class TraceSpan
+{
+    private:
+        TraceCategory category_;
+        const char *name_, *detail_;
+        double start_;
+        bool on_;
+
+    public:
+        TraceSpan(TraceCategory c, const char *name,
+                  const char *detail = NULL) :
+            category_(c), name_(name), detail_(detail), on_(TraceOn(c))
+        {
+            if (on_) {
+                Begin();
+            }
+        }
+        ~TraceSpan()
+        {
+            if (on_) {
+                End();
+            }
+        }
+
+    private:
+        void Begin(void);
+        void End(void);
+};
+
+
+/* Function: InitTrace()
+ * ---------------------
+ * Turn on the categories asked for if --trace was given. Call after
+ * ParseCommandLine.
+ */
+void InitTrace(void);
+
+
+/* Function: WriteTrace()
+ * ----------------------
+ * Write the spans recorded to the --trace file, if one was given.
+ */
+void WriteTrace(void);
+
+#endif
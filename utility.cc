@@ -10,7 +10,10 @@
 #include "list.h"
 
 static List<const char*> debugKeys;
+static List<const char*> optionNames;
+static List<const char*> optionValues;
 static const int BufferSize = 2048;
+static __thread std::string *captured = NULL;
 
 void Failure(const char *format, ...)
 {
@@ -18,7 +21,7 @@ void Failure(const char *format, ...)
   char errbuf[BufferSize];
   
   va_start(args, format);
-  vsprintf(errbuf, format, args);
+  vsnprintf(errbuf, sizeof(errbuf), format, args);
   va_end(args);
   fflush(stdout);
   fprintf(stderr,"\n*** Failure: %s\n\n", errbuf);
@@ -54,29 +57,123 @@ void SetDebugForKey(const char *key, bool value)
 void PrintDebug(const char *key, const char *format, ...)
 {
   va_list args;
-  char buf[BufferSize];
+  char small[BufferSize];
+  std::string large;
+  char *buf = small;
 
   if (!IsDebugOn(key))
      return;
   
   va_start(args, format);
-  vsprintf(buf, format, args);
+  int len = vsnprintf(small, sizeof(small), format, args);
   va_end(args);
-  printf("+++ (%s): %s%s", key, buf, buf[strlen(buf)-1] != '\n'? "\n" : "");
+  if (len >= BufferSize) { // a long map or list: format again on the heap
+     large.resize(len + 1);
+     va_start(args, format);
+     vsnprintf(&large[0], len + 1, format, args);
+     va_end(args);
+     buf = &large[0];
+  }
+  if (captured == NULL) {
+     printf("+++ (%s): %s%s", key, buf, buf[strlen(buf)-1] != '\n'? "\n" : "");
+     return;
+  }
+  captured->append("+++ (").append(key).append("): ").append(buf);
+  if (buf[strlen(buf)-1] != '\n')
+     captured->append("\n");
 }
 
+void CaptureDebug(std::string *buffer)
+{
+  captured = buffer;
+}
 
-void ParseCommandLine(int argc, char *argv[])
+
+static int OptionIndex(const char *name)
 {
-  if (argc == 1)
-    return;
-  
-  if (strcmp(argv[1], "-d") != 0) { // first arg is not -d
-    printf("Usage:   -d <debug-key-1> <debug-key-2> ... \n");
-    exit(2);
+   for (int i = 0; i < optionNames.NumElements(); i++)
+      if (!strcmp(optionNames.Nth(i), name)) return i;
+   return -1;
+}
+
+int GetOption(const char *name, int defaultValue)
+{
+  const char *value = GetStringOption(name);
+  if (value == NULL)
+    return defaultValue;
+
+  char *end;
+  long n = strtol(value, &end, 10);
+  if (*end != '\0' || end == value)
+    Failure("Option %s expects an integer, not \"%s\"", name, value);
+  return (int)n;
+}
+
+
+const char *GetStringOption(const char *name)
+{
+  int k = OptionIndex(name);
+  return (k == -1 ? NULL : optionValues.Nth(k));
+}
+
+
+void SetOption(const char *name, const char *value)
+{
+  int k = OptionIndex(name);
+  if (k != -1) {
+    optionValues.RemoveAt(k);
+    optionValues.InsertAt(value, k);
+  } else {
+    optionNames.Append(name);
+    optionValues.Append(value);
   }
+}
 
-  for (int i = 2; i < argc; i++)
-    SetDebugForKey(argv[i], true);
+
+void SetOption(const char *name, int value)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%d", value);
+  SetOption(name, strdup(buf));
+}
+
+
+// Accepts -fname=value or --name=value, and -fname or --name for
+// name=1; returns false for anything else
+static bool ParseOption(const char *arg)
+{
+  const char *name;
+  if (!strncmp(arg, "--", 2)) name = arg + 2;
+  else if (!strncmp(arg, "-f", 2)) name = arg + 2;
+  else return false;
+
+  const char *eq = strchr(name, '=');
+  if (eq == NULL && *name != '\0') {
+    SetOption(name, "1");
+    return true;
+  }
+  if (eq == NULL || eq == name || eq[1] == '\0') return false;
+
+  SetOption(strndup(name, eq - name), eq + 1);
+  return true;
+}
+
+
+void ParseCommandLine(int argc, char *argv[])
+{
+  bool debugging = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (ParseOption(argv[i]))
+      continue;
+    if (!debugging && !strcmp(argv[i], "-d"))
+      debugging = true;
+    else if (debugging)
+      SetDebugForKey(argv[i], true);
+    else {
+      printf("Usage:   [-fname[=value] ...] -d <debug-key-1> <debug-key-2> ... \n");
+      exit(2);
+    }
+  }
 }
 
@@ -9,6 +9,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string>
 
 
 /* Function: Failure()
@@ -52,6 +53,16 @@ void Failure(const char *format, ...);
 void PrintDebug(const char *key, const char *format, ...);
 
 
+/* Function: CaptureDebug()
+ * Usage: CaptureDebug(&buffer); ... CaptureDebug(NULL);
+ * -----------------------------------------------------
+ * Append the PrintDebug messages of the calling thread to the given
+ * string instead of printing them, until called again with NULL. Lets
+ * work split across threads print its messages in a fixed order.
+ */
+void CaptureDebug(std::string *buffer);
+
+
 /* Function: SetDebugForKey()
  * Usage: SetDebugForKey("scope", true);
  * -------------------------------------
@@ -72,11 +83,39 @@ bool IsDebugOn(const char *key);
 
 
 
+/* Function: GetOption()
+ * Usage: int limit = GetOption("inline-threshold", 12);
+ * ----------------------------------------------------
+ * Return the integer value given for a tuning option on the command
+ * line, or the default if it was not given. Options are written as
+ * -fname=value or --name=value; a bare -fname or --name sets it to 1.
+ */
+int GetOption(const char *name, int defaultValue);
+
+
+/* Function: GetStringOption()
+ * Usage: const char *path = GetStringOption("profile-in");
+ * -------------------------------------------------------
+ * Return the text given for an option, or NULL if it was not given.
+ */
+const char *GetStringOption(const char *name);
+
+
+/* Function: SetOption()
+ * Usage: SetOption("inline-threshold", 0);
+ * ---------------------------------------
+ * Set an option, as if it had been given on the command line.
+ */
+void SetOption(const char *name, int value);
+void SetOption(const char *name, const char *value);
+
+
+
 /* Function: ParseCommandLine
  * --------------------------
- * Turn on the debugging flags from the command line.  Verifies that
- * first argument is -d, and then interpret all the arguments that follow
- * as being flags to turn on.
+ * Turn on the debugging flags from the command line.  Tuning options
+ * (see GetOption) may appear anywhere; everything after -d is taken
+ * as a flag to turn on.
  */
 void ParseCommandLine(int argc, char *argv[]);
      
@@ -0,0 +1,202 @@
+/* File: xref.cc
+ * -------------
+ * Recording definitions and uses while checking, and writing them out
+ * as a sorted index.
+ */
+
+#include "xref.h"
+#include "ast.h"
+#include "ast_decl.h"
+#include "ast_stmt.h"
+#include "utility.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+bool xrefOn = false;
+
+struct Reference {
+    std::string name, context;
+    XrefKind kind;
+    int line, column;
+
+    bool operator<(const Reference &r) const
+    {
+        if (name != r.name) {
+            return name < r.name;
+        }
+        if (kind != r.kind) {
+            return kind < r.kind;
+        }
+        if (line != r.line) {
+            return line < r.line;
+        }
+        return column < r.column;
+    }
+};
+
+static std::vector<Reference> references;
+
+void InitXref(void)
+{
+    xrefOn = (GetStringOption("xref") != NULL);
+
+    return;
+}
+
+// Class.member for members and the name for top-level declarations;
+// false for locals and formals
+static bool QualifiedName(Decl *d, std::string *name)
+{
+    Decl *owner = dynamic_cast<Decl*>(d->parent());
+
+    if (dynamic_cast<FnDecl*>(d) != NULL) {
+        *name = dynamic_cast<FnDecl*>(d)->GetQualifiedName();
+        return true;
+    }
+    if (dynamic_cast<Program*>(d->parent()) != NULL) {
+        *name = d->id()->name();
+        return true;
+    }
+    if (dynamic_cast<ClassDecl*>(owner) != NULL ||
+        dynamic_cast<InterfaceDecl*>(owner) != NULL) {
+        *name = std::string(owner->id()->name()) + "." + d->id()->name();
+        return true;
+    }
+
+    return false;
+}
+
+static void Record(XrefKind kind, const std::string &name, yyltype *loc,
+                   const std::string &context)
+{
+    Reference r;
+
+    r.name = name;
+    r.kind = kind;
+    r.line = loc == NULL ? 0 : loc->first_line;
+    r.column = loc == NULL ? 0 : loc->first_column;
+    r.context = context;
+    references.push_back(r);
+
+    return;
+}
+
+static const char *DeclKind(Decl *d)
+{
+    bool member = dynamic_cast<Program*>(d->parent()) == NULL;
+
+    if (dynamic_cast<ClassDecl*>(d) != NULL) {
+        return "class";
+    } else if (dynamic_cast<InterfaceDecl*>(d) != NULL) {
+        return "interface";
+    } else if (dynamic_cast<FnDecl*>(d) != NULL) {
+        return member ? "method" : "function";
+    }
+    return member ? "field" : "variable";
+}
+
+void RecordDefinition(Decl *d)
+{
+    std::string name;
+
+    if (!xrefOn || !QualifiedName(d, &name)) {
+        return;
+    }
+    Record(XrefDefinition, name, d->id()->location(), DeclKind(d));
+    if (dynamic_cast<ClassDecl*>(d) != NULL ||
+        dynamic_cast<InterfaceDecl*>(d) != NULL) {
+        List<Node*> members;
+        d->GetChildren(&members);
+        for (Node *member : members) {
+            RecordDefinition(dynamic_cast<Decl*>(member));
+        }
+    }
+
+    return;
+}
+
+void RecordUse(XrefKind kind, Decl *d, Node *at)
+{
+    std::string name, context;
+
+    if (!xrefOn || !QualifiedName(d, &name)) {
+        return;
+    }
+    if (at->GetCurrentFn() != NULL) {
+        context = at->GetCurrentFn()->GetQualifiedName();
+    } else if (at->GetCurrentClass() != NULL) {
+        context = at->GetCurrentClass()->id()->name();
+    }
+    Record(kind, name, at->location(), context);
+
+    return;
+}
+
+// The offset of s in the string table, adding it the first time
+static int Intern(const std::string &s, std::map<std::string, int> *offsets,
+                  std::string *strings)
+{
+    std::map<std::string, int>::iterator it = offsets->find(s);
+
+    if (it == offsets->end()) {
+        it = offsets->insert(std::make_pair(s, (int)strings->size())).first;
+        strings->append(s.c_str(), s.size() + 1);
+    }
+
+    return it->second;
+}
+
+void WriteXref(void)
+{
+    const char *path = GetStringOption("xref");
+    const char *source = GetStringOption("xref-source");
+    std::map<std::string, int> offsets;
+    std::string strings(1, '\0'); // offset 0 is the empty string
+    std::vector<XrefEntry> entries;
+    XrefHeader h;
+
+    if (!xrefOn) {
+        return;
+    }
+    std::sort(references.begin(), references.end());
+    for (size_t i = 0; i < references.size(); i++) {
+        XrefEntry e;
+        e.name = Intern(references[i].name, &offsets, &strings);
+        e.kind = references[i].kind;
+        e.line = references[i].line;
+        e.column = references[i].column;
+        e.context = Intern(references[i].context, &offsets, &strings);
+        entries.push_back(e);
+    }
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, XrefMagic, sizeof(XrefMagic));
+    h.format = XrefFormat;
+    h.numEntries = entries.size();
+    h.source = Intern(source == NULL ? "<stdin>" : source, &offsets,
+                      &strings);
+    h.stringsSize = strings.size();
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        Failure("Cannot write cross-reference index %s: %s", path,
+                strerror(errno));
+    }
+    fwrite(&h, sizeof(h), 1, f);
+    if (!entries.empty()) {
+        fwrite(&entries[0], sizeof(XrefEntry), entries.size(), f);
+    }
+    fwrite(strings.data(), 1, strings.size(), f);
+    if (fclose(f) != 0) {
+        Failure("Cannot write cross-reference index %s: %s", path,
+                strerror(errno));
+    }
+    references.clear();
+
+    return;
+}
@@ -0,0 +1,83 @@
+/* File: xref.h
+ * ------------
+ * A cross-reference index of a program. With --xref=file, checking
+ * records every definition of a class, interface, field, method,
+ * global function or global variable, and every use that resolved to
+ * one, and a clean compile writes them to the index file. The xrefq
+ * tool answers "who calls Shape.Area" or "where is List.head written"
+ * from any number of such files. --xref-source=name gives the file
+ * name the index reports, since dcc reads its source from stdin.
+ *
+ * An index file is a header, an array of entries sorted by name, kind
+ * and position, and a string table. Names are qualified as Class.member
+ * and are offsets into the string table, so a query maps the file and
+ * binary searches it without reading the rest.
+ */
+
+#ifndef _H_xref
+#define _H_xref
+
+class Node;
+class Decl;
+
+enum XrefKind {
+    XrefDefinition, // context is what was declared: class, method, ...
+    XrefCall,       // calls of a function or method
+    XrefRead,       // reads of a field or global variable
+    XrefWrite,      // assignments to one
+    XrefType,       // a class or interface named as a type
+    XrefNew,        // instances created of a class
+    NumXrefKinds
+};
+
+struct XrefHeader {
+    char magic[8];   // "DCCXREF\0"
+    int format;
+    int numEntries;
+    int stringsSize; // bytes of strings after the entries
+    int source;      // the file the entries are in
+};
+
+struct XrefEntry {
+    int name;        // qualified name of the declaration
+    int kind;        // an XrefKind
+    int line, column;
+    int context;     // the enclosing function, class or kind of decl
+};
+
+static const char XrefMagic[8] = {'D', 'C', 'C', 'X', 'R', 'E', 'F', '\0'};
+static const int XrefFormat = 1;
+
+extern bool xrefOn;
+
+
+/* Function: InitXref()
+ * --------------------
+ * Turn on recording if --xref was given. Call after ParseCommandLine.
+ */
+void InitXref(void);
+
+
+/* Function: RecordDefinition()
+ * ----------------------------
+ * Record a top-level declaration and, for classes and interfaces, its
+ * members. Local variables and formals are not indexed.
+ */
+void RecordDefinition(Decl *d);
+
+
+/* Function: RecordUse()
+ * ---------------------
+ * Record a use of the declaration at the given node, usually its
+ * identifier. Uses of locals are ignored.
+ */
+void RecordUse(XrefKind kind, Decl *d, Node *at);
+
+
+/* Function: WriteXref()
+ * ---------------------
+ * Write what was recorded to the --xref file and start over.
+ */
+void WriteXref(void);
+
+#endif
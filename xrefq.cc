@@ -0,0 +1,156 @@
+/* File: xrefq.cc
+ * --------------
+ * Queries over the cross-reference indexes dcc writes with --xref:
+ *
+ *     xrefq [-k kind] name index...
+ *
+ * prints every entry for the name in the given index files, one per
+ * line as file:line:column: kind name (context). The name is qualified
+ * as Class.member for members; a trailing * matches every name with
+ * that prefix, so "List.*" lists all uses of List's members. The kind
+ * is one of def, call, read, write, type and new. A call is indexed
+ * under the method its receiver's static type declares, so calls
+ * through an interface are found under the interface's method.
+ *
+ * Each file is mapped and binary searched, so a query reads only the
+ * entries it prints.
+ */
+
+#include "xref.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char *kindNames[NumXrefKinds] = {
+    "def", "call", "read", "write", "type", "new"
+};
+
+static void Usage(void)
+{
+    fprintf(stderr, "Usage: xrefq [-k def|call|read|write|type|new] "
+            "name index...\n");
+    exit(2);
+}
+
+// The order of the name at s relative to the query; when prefix is
+// not negative, only that many characters of the query are compared
+static int Compare(const char *s, const char *query, int prefix)
+{
+    return prefix >= 0 ? strncmp(s, query, prefix) : strcmp(s, query);
+}
+
+/* Function: Query()
+ * -----------------
+ * Print the entries of one index file that match; returns how many
+ * matched, or -1 if the file is not an index.
+ */
+static int Query(const char *path, const char *query, int prefix,
+                 int kind)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    int found = 0;
+
+    if (fd < 0 || fstat(fd, &st) < 0 ||
+        st.st_size < (off_t)sizeof(XrefHeader)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    void *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return -1;
+    }
+
+    const XrefHeader *h = (const XrefHeader*)image;
+    const XrefEntry *entries = (const XrefEntry*)(h + 1);
+    const char *strings = (const char*)image + st.st_size - h->stringsSize;
+    if (memcmp(h->magic, XrefMagic, sizeof(XrefMagic)) != 0 ||
+        h->format != XrefFormat || h->numEntries < 0 ||
+        h->stringsSize <= 0 ||
+        (off_t)sizeof(XrefHeader) + (off_t)h->numEntries * sizeof(XrefEntry)
+        + h->stringsSize != st.st_size ||
+        strings[h->stringsSize - 1] != '\0' ||
+        h->source < 0 || h->source >= h->stringsSize) {
+        munmap(image, st.st_size);
+        return -1;
+    }
+
+    // The first entry not ordered before the query
+    int lo = 0, hi = h->numEntries;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int name = entries[mid].name;
+        if (name >= 0 && name < h->stringsSize &&
+            Compare(strings + name, query, prefix) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (int i = lo; i < h->numEntries; i++) {
+        const XrefEntry &e = entries[i];
+        if (e.name < 0 || e.name >= h->stringsSize ||
+            e.context < 0 || e.context >= h->stringsSize ||
+            e.kind < 0 || e.kind >= NumXrefKinds ||
+            Compare(strings + e.name, query, prefix) != 0) {
+            break;
+        }
+        if (kind >= 0 && e.kind != kind) {
+            continue;
+        }
+        printf("%s:%d:%d: %s %s", strings + h->source, e.line, e.column,
+               kindNames[e.kind], strings + e.name);
+        if (strings[e.context] != '\0') {
+            printf(" (%s)", strings + e.context);
+        }
+        printf("\n");
+        found++;
+    }
+    munmap(image, st.st_size);
+
+    return found;
+}
+
+int main(int argc, char *argv[])
+{
+    int kind = -1;
+    int arg = 1;
+
+    if (arg + 1 < argc && strcmp(argv[arg], "-k") == 0) {
+        for (kind = 0; kind < NumXrefKinds; kind++) {
+            if (strcmp(argv[arg + 1], kindNames[kind]) == 0) {
+                break;
+            }
+        }
+        if (kind == NumXrefKinds) {
+            Usage();
+        }
+        arg += 2;
+    }
+    if (arg + 2 > argc) {
+        Usage();
+    }
+
+    const char *query = argv[arg++];
+    int length = strlen(query);
+    int prefix = (length > 0 && query[length - 1] == '*') ? length - 1 : -1;
+    int found = 0;
+    for (; arg < argc; arg++) {
+        int n = Query(argv[arg], query, prefix, kind);
+        if (n < 0) {
+            fprintf(stderr, "xrefq: %s is not a dcc index\n", argv[arg]);
+        } else {
+            found += n;
+        }
+    }
+
+    return found > 0 ? 0 : 1;
+}